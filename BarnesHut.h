@@ -0,0 +1,153 @@
+#ifndef BARNESHUT_H
+#define BARNESHUT_H
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+#include "Gravity.h"
+#include "Octree.h"
+using namespace std;
+
+// Barnes-Hut fragment self-gravity. A node of edge s at distance d from
+// the target is replaced by its centre of mass when s < theta*d; smaller
+// theta is more accurate and slower (theta = 0 is the direct sum).
+// Pairwise forces use Plummer softening: a = G m d / (|d|^2 + eps^2)^1.5.
+class BarnesHutGravity{
+    public:
+
+    float theta = 0.5f;
+    float softening = 0.01f;
+    Octree tree;
+
+    // Per-node monopole: total mass and centre of mass.
+    vector<float> nodeMass, comX, comY, comZ;
+
+    // Adds the self-gravity acceleration of every fragment to ax/ay/az.
+    void accumulate(FragmentSoA& fragments, bool parallel = true){
+        if(fragments.size() < 2) return;
+        tree.build(fragments, parallel);
+        computeMoments(parallel);
+        accumulateTargets(fragments, nullptr, (long)tree.size(), parallel);
+    }
+
+    // Same, but only the listed fragments are walked; the tree still holds
+    // every fragment as a source. With refit the previous call's tree is
+    // refitted to the current positions rather than rebuilt. Used by the
+    // block timestepper, which rebuilds once per frame step.
+    void accumulateActive(FragmentSoA& fragments, const vector<uint32_t>& active, bool refit, bool parallel = true){
+        if(fragments.size() < 2 || active.empty()) return;
+        if(refit && tree.size() == fragments.size()) tree.refit(fragments, parallel);
+        else tree.build(fragments, parallel);
+        computeMoments(parallel);
+
+        targets.resize(active.size());
+        for(size_t k = 0; k < active.size(); ++k) targets[k] = tree.slot[active[k]];
+        sort(targets.begin(), targets.end());
+        accumulateTargets(fragments, targets.data(), (long)targets.size(), parallel);
+    }
+
+    private:
+
+    vector<uint32_t> targets;   // sorted slots of the active fragments
+
+    // Walks the tree for `count` sorted slots, or for every slot if slots
+    // is null.
+    void accumulateTargets(FragmentSoA& fragments, const uint32_t* slots, long count, bool parallel){
+        const float theta2 = theta*theta;
+        const float eps2 = softening*softening;
+
+        // Targets are walked in Morton order so neighbouring iterations
+        // open nearly the same nodes.
+        #pragma omp parallel for schedule(dynamic, 64) if(parallel)
+        for(long k = 0; k < count; ++k){
+            const long i = slots ? (long)slots[k] : k;
+            uint32_t f = tree.order[i];
+            float ax = 0.0f, ay = 0.0f, az = 0.0f;
+            walk(i, tree.x[i], tree.y[i], tree.z[i], theta2, eps2, ax, ay, az);
+            fragments.ax[f] += G*ax;
+            fragments.ay[f] += G*ay;
+            fragments.az[f] += G*az;
+        }
+    }
+
+    void computeMoments(bool parallel){
+        const size_t count = tree.nodes.size();
+        nodeMass.assign(count, 0.0f);
+        comX.assign(count, 0.0f);
+        comY.assign(count, 0.0f);
+        comZ.assign(count, 0.0f);
+
+        for(int level = (int)tree.levels.size() - 1; level >= 0; --level){
+            const vector<int>& ids = tree.levels[level];
+            #pragma omp parallel for schedule(static) if(parallel)
+            for(long k = 0; k < (long)ids.size(); ++k){
+                const int id = ids[k];
+                const OctreeNode& node = tree.nodes[id];
+                double mass = 0.0, sx = 0.0, sy = 0.0, sz = 0.0;
+                if(tree.isLeaf(node)){
+                    for(int s = node.begin; s < node.end; ++s){
+                        mass += tree.m[s];
+                        sx += (double)tree.m[s]*tree.x[s];
+                        sy += (double)tree.m[s]*tree.y[s];
+                        sz += (double)tree.m[s]*tree.z[s];
+                    }
+                } else {
+                    for(int c = node.firstChild; c < node.firstChild + node.childCount; ++c){
+                        mass += nodeMass[c];
+                        sx += (double)nodeMass[c]*comX[c];
+                        sy += (double)nodeMass[c]*comY[c];
+                        sz += (double)nodeMass[c]*comZ[c];
+                    }
+                }
+                nodeMass[id] = (float)mass;
+                if(mass > 0.0){
+                    comX[id] = (float)(sx/mass);
+                    comY[id] = (float)(sy/mass);
+                    comZ[id] = (float)(sz/mass);
+                } else {
+                    comX[id] = node.cx; comY[id] = node.cy; comZ[id] = node.cz;
+                }
+            }
+        }
+    }
+
+    void walk(long self, float px, float py, float pz, float theta2, float eps2,
+              float& ax, float& ay, float& az) const {
+        int stack[8*Octree::maxLevel + 8];
+        int top = 0;
+        stack[top++] = 0;
+        while(top > 0){
+            const int id = stack[--top];
+            const OctreeNode& node = tree.nodes[id];
+
+            if(tree.isLeaf(node)){
+                for(int s = node.begin; s < node.end; ++s){
+                    if(s == self) continue;
+                    float dx = tree.x[s] - px, dy = tree.y[s] - py, dz = tree.z[s] - pz;
+                    float r2 = dx*dx + dy*dy + dz*dz + eps2;
+                    float inv = 1.0f/sqrtf(r2);
+                    float w = tree.m[s]*inv*inv*inv;
+                    ax += w*dx; ay += w*dy; az += w*dz;
+                }
+                continue;
+            }
+
+            float dx = comX[id] - px, dy = comY[id] - py, dz = comZ[id] - pz;
+            float r2 = dx*dx + dy*dy + dz*dz + eps2;
+            float size = 2.0f*node.halfSize;
+            bool inside = fabsf(px - node.cx) <= node.halfSize &&
+                          fabsf(py - node.cy) <= node.halfSize &&
+                          fabsf(pz - node.cz) <= node.halfSize;
+            if(!inside && size*size < theta2*r2){
+                float inv = 1.0f/sqrtf(r2);
+                float w = nodeMass[id]*inv*inv*inv;
+                ax += w*dx; ay += w*dy; az += w*dz;
+            } else {
+                for(int c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+                    stack[top++] = c;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef BLOCKTIMESTEP_H
+#define BLOCKTIMESTEP_H
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <omp.h>
+#include "Integrator.h"
+using namespace std;
+
+// Hierarchical (block) timesteps for the fragment store.
+//
+// A frame step dTime is split into power-of-two bins: a fragment on level L
+// advances with dTime/2^L, so fragments skimming the planet can sit on fine
+// levels while the ones flung outward take the whole frame in one step.
+// Every fragment runs its own kick-drift-kick leapfrog. All positions are
+// drifted at each substep, so sources are always current, but forces are
+// only evaluated for the fragments whose step ends there (the active set).
+// Fragments are kept in one bin per level, so a substep takes its active
+// set from the bins it closes instead of scanning every fragment.
+//
+// Levels come from the acceleration/jerk timescale tau = |a|/|da/dt|, with
+// the jerk taken from the change in acceleration over the last step
+// (|v|/|a| before the first one), and dt = eta*tau. A fragment may move to
+// a finer level at any of its boundaries, and to a coarser one only where
+// the new step stays aligned with the block.
+class BlockTimestepper{
+    public:
+
+    float eta = 0.02f;          // accuracy parameter, fraction of tau
+    int maxLevel = 8;           // finest step is dTime/2^maxLevel
+
+    // Per-fragment state, indexed like the fragment store.
+    vector<uint8_t> level;
+    vector<float> timescale;
+    aligned_vector<float> accX, accY, accZ;     // acceleration at the last evaluation
+
+    // Statistics of the last step.
+    long forceEvaluations = 0;  // fragment force evaluations, as reported by computeAcceleration
+    int substeps = 0;
+
+    // Advances every fragment by dTime. computeAcceleration(fragments,
+    // active, refit) must write ax/ay/az of the listed fragments (others
+    // may be clobbered) and return how many fragments it evaluated. refit
+    // is false on the first evaluation of a step and true on the later
+    // ones, where positions have only moved by a substep since the last.
+    template<typename AccelFn>
+    void step(FragmentSoA& fragments, float dTime, bool parallel, AccelFn computeAcceleration){
+        const long n = (long)fragments.size();
+        forceEvaluations = 0;
+        substeps = 0;
+        if(n == 0 || dTime <= 0.0f) return;
+        const int levels = min(maxLevel, 30);
+        const uint32_t ticks = 1u << levels;
+        const double tickTime = (double)dTime/ticks;
+
+        if((long)level.size() != n) initialize(fragments, parallel, computeAcceleration);
+
+        float* vx = fragments.vx.data();
+        float* vy = fragments.vy.data();
+        float* vz = fragments.vz.data();
+
+        // Every step starts at the block boundary: pick levels, open with a
+        // half kick from the stored acceleration.
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long i = 0; i < n; ++i){
+            level[i] = (uint8_t)levelFor(timescale[i], dTime, levels);
+            float h = (float)(0.5*tickTime*(ticks >> level[i]));
+            vx[i] += accX[i]*h; vy[i] += accY[i]*h; vz[i] += accZ[i]*h;
+        }
+        bins.resize(levels + 1);
+        for(vector<uint32_t>& bin : bins) bin.clear();
+        for(long i = 0; i < n; ++i) bins[level[i]].push_back((uint32_t)i);
+
+        uint32_t t = 0;
+        bool refit = false;
+        while(t < ticks){
+            // Next boundary of any populated level.
+            uint32_t next = ticks;
+            for(int L = 0; L <= levels; ++L){
+                if(bins[L].empty()) continue;
+                uint32_t stride = ticks >> L;
+                next = min(next, (t/stride + 1)*stride);
+            }
+            driftFragments(fragments, (float)((next - t)*tickTime), parallel);
+            t = next;
+            ++substeps;
+
+            // t closes the steps of every level from `first` down. Those
+            // bins are emptied here and refilled below with the new levels,
+            // which are aligned with t and so never coarser than `first`.
+            int first = levels;
+            while(first > 0 && t % (ticks >> (first - 1)) == 0) --first;
+            active.clear();
+            for(int L = first; L <= levels; ++L){
+                active.insert(active.end(), bins[L].begin(), bins[L].end());
+                bins[L].clear();
+            }
+            sort(active.begin(), active.end());
+            forceEvaluations += computeAcceleration(fragments, active, refit);
+            refit = true;
+
+            const long count = (long)active.size();
+            #pragma omp parallel for schedule(static) if(parallel)
+            for(long k = 0; k < count; ++k){
+                const uint32_t i = active[k];
+                const float ax = fragments.ax[i], ay = fragments.ay[i], az = fragments.az[i];
+                const double dt = tickTime*(ticks >> level[i]);
+
+                // Close the finished step.
+                vx[i] += ax*(float)(0.5*dt); vy[i] += ay*(float)(0.5*dt); vz[i] += az*(float)(0.5*dt);
+
+                float jx = ax - accX[i], jy = ay - accY[i], jz = az - accZ[i];
+                float jerk = sqrtf(jx*jx + jy*jy + jz*jz)/(float)dt;
+                float a = sqrtf(ax*ax + ay*ay + az*az);
+                timescale[i] = jerk > 0.0f ? a/jerk : FLT_MAX;
+                accX[i] = ax; accY[i] = ay; accZ[i] = az;
+
+                // Open the next one, on a level aligned with t.
+                if(t < ticks){
+                    int L = levelFor(timescale[i], dTime, levels);
+                    while(t % (ticks >> L) != 0) ++L;
+                    level[i] = (uint8_t)L;
+                    float h = (float)(0.5*tickTime*(ticks >> L));
+                    vx[i] += ax*h; vy[i] += ay*h; vz[i] += az*h;
+                }
+            }
+
+            for(uint32_t i : active) bins[level[i]].push_back(i);
+        }
+        fragments.accelerationCurrent = false;
+    }
+
+    // Forgets the per-fragment state; the next step re-evaluates forces.
+    void reset(){
+        level.clear(); timescale.clear();
+        accX.clear(); accY.clear(); accZ.clear();
+    }
+
+    private:
+
+    vector<uint32_t> active;
+    vector<vector<uint32_t>> bins;      // fragment indices by level
+
+    int levelFor(float tau, float dTime, int levels) const {
+        const float wanted = eta*tau;
+        if(!(wanted < dTime)) return 0;
+        if(wanted <= 0.0f) return levels;
+        int L = (int)ceilf(log2f(dTime/wanted));
+        return min(max(L, 0), levels);
+    }
+
+    template<typename AccelFn>
+    void initialize(FragmentSoA& fragments, bool parallel, AccelFn& computeAcceleration){
+        const long n = (long)fragments.size();
+        level.assign(n, 0);
+        timescale.assign(n, 0.0f);
+        accX.resize(n); accY.resize(n); accZ.resize(n);
+
+        active.resize(n);
+        for(long i = 0; i < n; ++i) active[i] = (uint32_t)i;
+        forceEvaluations += computeAcceleration(fragments, active, false);
+
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long i = 0; i < n; ++i){
+            const float ax = fragments.ax[i], ay = fragments.ay[i], az = fragments.az[i];
+            const float a = sqrtf(ax*ax + ay*ay + az*az);
+            const float v = sqrtf(fragments.vx[i]*fragments.vx[i] + fragments.vy[i]*fragments.vy[i] +
+                                  fragments.vz[i]*fragments.vz[i]);
+            accX[i] = ax; accY[i] = ay; accZ[i] = az;
+            timescale[i] = a > 0.0f ? v/a : FLT_MAX;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef BODY_H
+#define BODY_H
+#include <glm/glm.hpp>
+
+class Body{
+    public:
+
+    glm::vec3 position;
+    glm::vec3 velocity;
+    float mass;
+    
+    
+    Body(glm::vec3 pos, glm::vec3 vel, float m):position(pos), velocity(vel), mass(m){}
+    
+};
+
+#endif
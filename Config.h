@@ -0,0 +1,286 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include "MoonMaker.h"
+#include "Simulation.h"
+using namespace std;
+
+// Scenario setup from an INI file plus command-line overrides, replacing
+// the interactive prompts. Keys are "section.name":
+//
+//   [planet]      mass, radius
+//   [moon]        mass, radius, distance, velocity_y, velocity_z,
+//                 fragment_radius, packing (cubic | fcc | hcp | poisson;
+//                 poisson takes ~0.5 s at fragment_radius 0.01 where
+//                 cubic takes ~5 ms)
+//   [simulation]  integrator (euler | leapfrog | yoshida4),
+//                 timestepping (global | block: per-fragment leapfrog
+//                 levels after breakup, the integrator then only moves
+//                 the intact moon),
+//                 gravity (planet | barneshut | fmm | direct | pm),
+//                 timestep, steps, threads (0 = OpenMP default), output
+//
+// A file may hold several scenarios: sections named "name.planet" etc.
+// belong to scenario "name" and override the unprefixed ones when that
+// scenario is selected. On the command line every key can be given as
+// --section.name=value; --config=FILE and --scenario=NAME pick the file
+// and scenario, and --steps, --threads, --output, --integrator,
+// --timestepping, --gravity and --timestep are shorthands for the
+// [simulation] keys.
+struct Scenario{
+    float planetMass = 1000.0f, planetRadius = 1.0f;
+    float moonMass = 10.0f, moonRadius = 0.5f;
+    float moonDistance = 8.0f, moonVelocityY = 3.0f, moonVelocityZ = 0.0f;
+    float fragmentRadius = 0.05f;
+    FragmentPacking packing = FragmentPacking::Cubic;
+    IntegratorType integrator = IntegratorType::Leapfrog;
+    bool blockTimesteps = false;
+    GravityBackend gravity = GravityBackend::PlanetOnly;
+    double timestep = 1.0/120.0;
+    long steps = 1000;
+    int threads = 0;
+    string output = "roche_headless.csv";
+};
+
+inline const char* gravityBackendName(GravityBackend backend){
+    switch(backend){
+        case GravityBackend::BarnesHut:    return "barneshut";
+        case GravityBackend::FMM:          return "fmm";
+        case GravityBackend::Direct:       return "direct";
+        case GravityBackend::ParticleMesh: return "pm";
+        default:                           return "planet";
+    }
+}
+
+inline const char* fragmentPackingName(FragmentPacking packing){
+    switch(packing){
+        case FragmentPacking::FCC:     return "fcc";
+        case FragmentPacking::HCP:     return "hcp";
+        case FragmentPacking::Poisson: return "poisson";
+        default:                       return "cubic";
+    }
+}
+
+// The MoonMaker generator for a packing, in its serial or parallel form.
+inline FragmentMaker fragmentMaker(FragmentPacking packing, bool parallel){
+    switch(packing){
+        case FragmentPacking::FCC:     return parallel ? parallel_calculate_fcc_centres_and_mass : serial_calculate_fcc_centres_and_mass;
+        case FragmentPacking::HCP:     return parallel ? parallel_calculate_hcp_centres_and_mass : serial_calculate_hcp_centres_and_mass;
+        case FragmentPacking::Poisson: return parallel ? parallel_calculate_poisson_centres_and_mass : serial_calculate_poisson_centres_and_mass;
+        default:                       return parallel ? parallel_calculate_centres_and_mass_serial : serial_calculate_centres_and_mass_serial;
+    }
+}
+
+// Flat key -> value store filled from INI text and --key=value arguments.
+class Config{
+    public:
+
+    map<string, string> values;
+
+    // Reads an INI file. Returns false and sets error on failure.
+    bool loadFile(const string& path, string& error){
+        ifstream in(path);
+        if(!in){
+            error = "cannot open " + path;
+            return false;
+        }
+        string line, section;
+        int lineNumber = 0;
+        while(getline(in, line)){
+            ++lineNumber;
+            size_t comment = line.find_first_of("#;");
+            if(comment != string::npos) line.erase(comment);
+            line = trim(line);
+            if(line.empty()) continue;
+            if(line.front() == '['){
+                if(line.back() != ']'){
+                    error = path + ":" + to_string(lineNumber) + ": unterminated section";
+                    return false;
+                }
+                section = trim(line.substr(1, line.size() - 2));
+                continue;
+            }
+            size_t eq = line.find('=');
+            if(eq == string::npos){
+                error = path + ":" + to_string(lineNumber) + ": expected key = value";
+                return false;
+            }
+            string key = trim(line.substr(0, eq));
+            values[section.empty() ? key : section + "." + key] = trim(line.substr(eq + 1));
+        }
+        return true;
+    }
+
+    void set(const string& key, const string& value){ values[key] = value; }
+
+    static string trim(const string& s){
+        size_t begin = 0, end = s.size();
+        while(begin < end && isspace((unsigned char)s[begin])) ++begin;
+        while(end > begin && isspace((unsigned char)s[end - 1])) --end;
+        return s.substr(begin, end - begin);
+    }
+};
+
+// Applies every key of the selected scenario. Unknown keys and malformed
+// numbers are errors, so a typo cannot silently fall back to a default.
+inline bool applyConfig(const Config& config, const string& scenarioName, Scenario& scenario, string& error){
+    // Unprefixed "section.name" keys first, then the named scenario's.
+    vector<pair<string, string>> selected;
+    bool found = scenarioName.empty();
+    for(int pass = 0; pass < 2; ++pass){
+        for(const auto& kv : config.values){
+            size_t dot = kv.first.rfind('.');
+            size_t sectionDot = dot == string::npos || dot == 0 ? string::npos : kv.first.rfind('.', dot - 1);
+            string owner = sectionDot == string::npos ? "" : kv.first.substr(0, sectionDot);
+            if(pass == 0 && owner.empty()) selected.emplace_back(kv.first, kv.second);
+            if(pass == 1 && !owner.empty() && owner == scenarioName){
+                selected.emplace_back(kv.first.substr(sectionDot + 1), kv.second);
+                found = true;
+            }
+        }
+    }
+    if(!found){
+        error = "no scenario named " + scenarioName;
+        return false;
+    }
+
+    for(const auto& kv : selected){
+        const string& key = kv.first;
+        const string& value = kv.second;
+        char* end = nullptr;
+        double number = strtod(value.c_str(), &end);
+        bool numeric = !value.empty() && end && *end == '\0';
+        auto requireNumber = [&](){
+            if(!numeric) error = key + ": expected a number, got '" + value + "'";
+            return numeric;
+        };
+
+        if(key == "planet.mass"){ if(!requireNumber()) return false; scenario.planetMass = (float)number; }
+        else if(key == "planet.radius"){ if(!requireNumber()) return false; scenario.planetRadius = (float)number; }
+        else if(key == "moon.mass"){ if(!requireNumber()) return false; scenario.moonMass = (float)number; }
+        else if(key == "moon.radius"){ if(!requireNumber()) return false; scenario.moonRadius = (float)number; }
+        else if(key == "moon.distance"){ if(!requireNumber()) return false; scenario.moonDistance = (float)number; }
+        else if(key == "moon.velocity_y"){ if(!requireNumber()) return false; scenario.moonVelocityY = (float)number; }
+        else if(key == "moon.velocity_z"){ if(!requireNumber()) return false; scenario.moonVelocityZ = (float)number; }
+        else if(key == "moon.fragment_radius"){ if(!requireNumber()) return false; scenario.fragmentRadius = (float)number; }
+        else if(key == "simulation.timestep"){ if(!requireNumber()) return false; scenario.timestep = number; }
+        else if(key == "simulation.steps"){ if(!requireNumber()) return false; scenario.steps = (long)number; }
+        else if(key == "simulation.threads"){ if(!requireNumber()) return false; scenario.threads = (int)number; }
+        else if(key == "simulation.output") scenario.output = value;
+        else if(key == "simulation.integrator"){
+            if(value == "euler") scenario.integrator = IntegratorType::SemiImplicitEuler;
+            else if(value == "leapfrog") scenario.integrator = IntegratorType::Leapfrog;
+            else if(value == "yoshida4") scenario.integrator = IntegratorType::Yoshida4;
+            else { error = key + ": unknown integrator '" + value + "'"; return false; }
+        }
+        else if(key == "simulation.timestepping"){
+            if(value == "global") scenario.blockTimesteps = false;
+            else if(value == "block") scenario.blockTimesteps = true;
+            else { error = key + ": unknown timestepping '" + value + "'"; return false; }
+        }
+        else if(key == "moon.packing"){
+            if(value == "cubic") scenario.packing = FragmentPacking::Cubic;
+            else if(value == "fcc") scenario.packing = FragmentPacking::FCC;
+            else if(value == "hcp") scenario.packing = FragmentPacking::HCP;
+            else if(value == "poisson") scenario.packing = FragmentPacking::Poisson;
+            else { error = key + ": unknown packing '" + value + "'"; return false; }
+        }
+        else if(key == "simulation.gravity"){
+            if(value == "planet") scenario.gravity = GravityBackend::PlanetOnly;
+            else if(value == "barneshut") scenario.gravity = GravityBackend::BarnesHut;
+            else if(value == "fmm") scenario.gravity = GravityBackend::FMM;
+            else if(value == "direct") scenario.gravity = GravityBackend::Direct;
+            else if(value == "pm") scenario.gravity = GravityBackend::ParticleMesh;
+            else { error = key + ": unknown gravity backend '" + value + "'"; return false; }
+        }
+        else { error = "unknown key " + key; return false; }
+    }
+
+    if(scenario.planetMass <= 0 || scenario.planetRadius <= 0 || scenario.moonMass <= 0 ||
+       scenario.moonRadius <= 0 || scenario.fragmentRadius <= 0 || scenario.timestep <= 0){
+        error = "masses, radii, fragment_radius and timestep must be positive";
+        return false;
+    }
+    if(scenario.steps < 0){
+        error = "steps must be non-negative";
+        return false;
+    }
+    return true;
+}
+
+// --steps etc. stand for the [simulation] key of the same name.
+inline string expandShorthand(const string& key){
+    if(key == "steps" || key == "threads" || key == "output" || key == "integrator" || key == "gravity" ||
+       key == "timestep" || key == "timestepping")
+        return "simulation." + key;
+    return key;
+}
+
+inline void printUsage(const char* program){
+    cerr << "usage: " << program << " [--config=FILE] [--scenario=NAME] [--section.key=value ...]\n"
+            "  keys: planet.mass planet.radius moon.mass moon.radius moon.distance moon.velocity_y\n"
+            "        moon.velocity_z moon.fragment_radius moon.packing simulation.integrator\n"
+            "        simulation.timestepping simulation.gravity simulation.timestep simulation.steps\n"
+            "        simulation.threads simulation.output\n"
+            "  shorthands: --steps --threads --output --integrator --timestepping --gravity --timestep\n";
+}
+
+// Builds the scenario from the command line: defaults, then the config
+// file, then --key=value overrides. Prints the problem and usage on error.
+inline bool loadScenario(int argc, char** argv, Scenario& scenario){
+    Config config, overrides;
+    string configPath, scenarioName, error;
+    for(int i = 1; i < argc; ++i){
+        string arg = argv[i];
+        if(arg == "-h" || arg == "--help"){ printUsage(argv[0]); return false; }
+        if(arg.compare(0, 2, "--") != 0){
+            cerr << "unexpected argument " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+        arg = arg.substr(2);
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq), value;
+        if(eq != string::npos) value = arg.substr(eq + 1);
+        else if(i + 1 < argc) value = argv[++i];
+        if(key == "config") configPath = value;
+        else if(key == "scenario") scenarioName = value;
+        else overrides.set(expandShorthand(key), value);
+    }
+
+    if(!configPath.empty() && !config.loadFile(configPath, error)){
+        cerr << error << "\n";
+        return false;
+    }
+    if(!applyConfig(config, scenarioName, scenario, error) || !applyConfig(overrides, "", scenario, error)){
+        cerr << error << "\n";
+        printUsage(argv[0]);
+        return false;
+    }
+    // Covers drivers that step on the main thread; PhysicsThread sets the
+    // count again on its own thread, since it is per calling thread.
+    if(scenario.threads > 0) omp_set_num_threads(scenario.threads);
+    return true;
+}
+
+// Pushes the scenario's physics settings into a simulation. The fragment
+// generator follows the packing, serial or parallel like the simulation.
+inline void applyScenario(const Scenario& scenario, Simulation& simulation){
+    simulation.fragmentRadius = scenario.fragmentRadius;
+    simulation.makeFragments = fragmentMaker(scenario.packing, simulation.parallel);
+    simulation.integrator = scenario.integrator;
+    simulation.blockTimesteps = scenario.blockTimesteps;
+    simulation.selfGravity.backend = scenario.gravity;
+    simulation.clock.step = scenario.timestep;
+    simulation.threads = scenario.threads;
+}
+
+#endif
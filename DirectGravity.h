@@ -0,0 +1,177 @@
+#ifndef DIRECTGRAVITY_H
+#define DIRECTGRAVITY_H
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+#include "Gravity.h"
+using namespace std;
+
+// Exact all-pairs fragment self-gravity, the reference the approximate
+// backends are checked against. This is the commented-out loop that used
+// to sit at the bottom of Gravity.h, made fast enough to run every frame
+// at a few tens of thousands of fragments:
+//  - sources are walked in j-tiles of `tileSize` (4 floats each, 16 KB at
+//    the default) so a tile stays in L1 while a block of targets uses it;
+//  - the inner j loop is an omp simd reduction over the SoA arrays;
+//  - the parallel path splits targets into i-blocks across threads, the
+//    serial path visits each pair once and applies Newton's third law.
+// Per-tile float partial sums are accumulated in double. Build with
+// -fno-math-errno: otherwise GCC keeps an errno check on every sqrtf in
+// the inner loops and the kernel runs several times slower.
+class DirectGravity{
+    public:
+
+    float softening = 0.01f;    // Plummer softening length
+    int tileSize = 1024;
+    int blockSize = 64;         // targets per OpenMP work item
+
+    // Adds the self-gravity acceleration of every fragment to ax/ay/az.
+    void accumulate(FragmentSoA& fragments, bool parallel = true){
+        if(fragments.size() < 2) return;
+        if(parallel && omp_get_max_threads() > 1) accumulateBlocks(fragments);
+        else accumulateSymmetric(fragments);
+    }
+
+    // Adds the acceleration of the listed fragments only, each summed over
+    // every source. Used by the block timestepper.
+    void accumulateActive(FragmentSoA& fragments, const vector<uint32_t>& active, bool parallel = true){
+        const long n = (long)fragments.size();
+        const long count = (long)active.size();
+        if(n < 2 || count == 0) return;
+        const float* px = fragments.px.data();
+        const float* py = fragments.py.data();
+        const float* pz = fragments.pz.data();
+        const float* mass = fragments.mass.data();
+        const float eps2 = softening*softening;
+        const long tile = tileSize;
+
+        #pragma omp parallel for schedule(dynamic, 16) if(parallel)
+        for(long k = 0; k < count; ++k){
+            const long i = active[k];
+            const float xi = px[i], yi = py[i], zi = pz[i];
+            double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+            for(long jt = 0; jt < n; jt += tile){
+                const long jEnd = min(jt + tile, n);
+                float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                #pragma omp simd reduction(+:ax,ay,az)
+                for(long j = jt; j < jEnd; ++j){
+                    float dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+                    float r2 = dx*dx + dy*dy + dz*dz + eps2;
+                    float inv = 1.0f/sqrtf(r2);
+                    float w = j == i ? 0.0f : mass[j]*inv*inv*inv;
+                    ax += w*dx; ay += w*dy; az += w*dz;
+                }
+                sumX += ax; sumY += ay; sumZ += az;
+            }
+            fragments.ax[i] += (float)(G*sumX);
+            fragments.ay[i] += (float)(G*sumY);
+            fragments.az[i] += (float)(G*sumZ);
+        }
+    }
+
+    private:
+
+    void accumulateBlocks(FragmentSoA& fragments){
+        const long n = (long)fragments.size();
+        const float* px = fragments.px.data();
+        const float* py = fragments.py.data();
+        const float* pz = fragments.pz.data();
+        const float* mass = fragments.mass.data();
+        const float eps2 = softening*softening;
+        const long tile = tileSize, block = blockSize;
+
+        #pragma omp parallel
+        {
+            vector<double> sumX(block), sumY(block), sumZ(block);
+
+            #pragma omp for schedule(dynamic, 1)
+            for(long ib = 0; ib < n; ib += block){
+                const long iEnd = min(ib + block, n);
+                fill(sumX.begin(), sumX.end(), 0.0);
+                fill(sumY.begin(), sumY.end(), 0.0);
+                fill(sumZ.begin(), sumZ.end(), 0.0);
+
+                for(long jt = 0; jt < n; jt += tile){
+                    const long jEnd = min(jt + tile, n);
+                    for(long i = ib; i < iEnd; ++i){
+                        const float xi = px[i], yi = py[i], zi = pz[i];
+                        float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                        #pragma omp simd reduction(+:ax,ay,az)
+                        for(long j = jt; j < jEnd; ++j){
+                            float dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+                            float r2 = dx*dx + dy*dy + dz*dz + eps2;
+                            float inv = 1.0f/sqrtf(r2);
+                            float w = j == i ? 0.0f : mass[j]*inv*inv*inv;
+                            ax += w*dx; ay += w*dy; az += w*dz;
+                        }
+                        sumX[i - ib] += ax; sumY[i - ib] += ay; sumZ[i - ib] += az;
+                    }
+                }
+
+                for(long i = ib; i < iEnd; ++i){
+                    fragments.ax[i] += (float)(G*sumX[i - ib]);
+                    fragments.ay[i] += (float)(G*sumY[i - ib]);
+                    fragments.az[i] += (float)(G*sumZ[i - ib]);
+                }
+            }
+        }
+    }
+
+    // Each pair is evaluated once; the reaction on j is gathered in a
+    // tile-local buffer so the inner loop still vectorizes.
+    void accumulateSymmetric(FragmentSoA& fragments){
+        const long n = (long)fragments.size();
+        const float* px = fragments.px.data();
+        const float* py = fragments.py.data();
+        const float* pz = fragments.pz.data();
+        const float* mass = fragments.mass.data();
+        const float eps2 = softening*softening;
+        const long tile = tileSize;
+
+        vector<double> sumX(n, 0.0), sumY(n, 0.0), sumZ(n, 0.0);
+        vector<float> reactX(tile), reactY(tile), reactZ(tile);
+
+        for(long it = 0; it < n; it += tile){
+            const long iEnd = min(it + tile, n);
+            for(long jt = it; jt < n; jt += tile){
+                const long jEnd = min(jt + tile, n);
+                fill(reactX.begin(), reactX.end(), 0.0f);
+                fill(reactY.begin(), reactY.end(), 0.0f);
+                fill(reactZ.begin(), reactZ.end(), 0.0f);
+                float* rx = reactX.data() - jt;
+                float* ry = reactY.data() - jt;
+                float* rz = reactZ.data() - jt;
+
+                for(long i = it; i < iEnd; ++i){
+                    const float xi = px[i], yi = py[i], zi = pz[i], mi = mass[i];
+                    const long jStart = jt == it ? i + 1 : jt;
+                    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                    #pragma omp simd reduction(+:ax,ay,az)
+                    for(long j = jStart; j < jEnd; ++j){
+                        float dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+                        float r2 = dx*dx + dy*dy + dz*dz + eps2;
+                        float inv = 1.0f/sqrtf(r2);
+                        float inv3 = inv*inv*inv;
+                        float wi = mass[j]*inv3, wj = mi*inv3;
+                        ax += wi*dx; ay += wi*dy; az += wi*dz;
+                        rx[j] -= wj*dx; ry[j] -= wj*dy; rz[j] -= wj*dz;
+                    }
+                    sumX[i] += ax; sumY[i] += ay; sumZ[i] += az;
+                }
+
+                for(long j = jt; j < jEnd; ++j){
+                    sumX[j] += rx[j]; sumY[j] += ry[j]; sumZ[j] += rz[j];
+                }
+            }
+        }
+
+        for(long i = 0; i < n; ++i){
+            fragments.ax[i] += (float)(G*sumX[i]);
+            fragments.ay[i] += (float)(G*sumY[i]);
+            fragments.az[i] += (float)(G*sumZ[i]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FFT_H
+#define FFT_H
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include <omp.h>
+using namespace std;
+
+// Small in-tree FFT for the particle-mesh solver: iterative radix-2
+// Cooley-Tukey on power-of-two lengths, and a 3D transform that runs the
+// 1D transform along x, y and z with the lines of each pass spread over
+// OpenMP threads.
+class FFT3D{
+    public:
+
+    explicit FFT3D(int size = 0){ resize(size); }
+
+    int size() const { return n; }
+
+    // size must be a power of two.
+    void resize(int size){
+        n = size;
+        rev.assign(n, 0);
+        twiddle.assign(n/2, complex<double>(1.0, 0.0));
+        int bits = 0;
+        while((1 << bits) < n) ++bits;
+        for(int i = 0; i < n; ++i){
+            uint32_t r = 0;
+            for(int b = 0; b < bits; ++b)
+                if(i & (1 << b)) r |= 1u << (bits - 1 - b);
+            rev[i] = r;
+        }
+        for(int k = 0; k < n/2; ++k)
+            twiddle[k] = polar(1.0, -2.0*M_PI*k/n);
+    }
+
+    // In-place transform of n contiguous values. The inverse is not scaled.
+    void transform1D(complex<double>* a, bool inverse) const {
+        for(int i = 0; i < n; ++i)
+            if((int)rev[i] > i) swap(a[i], a[rev[i]]);
+        for(int len = 2; len <= n; len <<= 1){
+            const int half = len >> 1, step = n/len;
+            for(int start = 0; start < n; start += len){
+                for(int k = 0; k < half; ++k){
+                    complex<double> w = inverse ? conj(twiddle[k*step]) : twiddle[k*step];
+                    complex<double> u = a[start + k];
+                    complex<double> v = a[start + k + half]*w;
+                    a[start + k] = u + v;
+                    a[start + k + half] = u - v;
+                }
+            }
+        }
+    }
+
+    // In-place transform of an n^3 grid stored x-fastest
+    // (index = x + n*(y + n*z)). The inverse is scaled by 1/n^3.
+    void transform3D(vector<complex<double>>& grid, bool inverse, bool parallel = true) const {
+        const long n2 = (long)n*n;
+
+        // x lines are contiguous.
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long line = 0; line < n2; ++line)
+            transform1D(&grid[line*n], inverse);
+
+        // y and z lines are gathered into a contiguous buffer first.
+        for(int axis = 1; axis <= 2; ++axis){
+            const long stride = axis == 1 ? n : n2;
+            #pragma omp parallel if(parallel)
+            {
+                vector<complex<double>> buffer(n);
+                #pragma omp for schedule(static)
+                for(long line = 0; line < n2; ++line){
+                    long base = axis == 1 ? (line % n) + (line/n)*n2 : line;
+                    for(int i = 0; i < n; ++i) buffer[i] = grid[base + i*stride];
+                    transform1D(buffer.data(), inverse);
+                    for(int i = 0; i < n; ++i) grid[base + i*stride] = buffer[i];
+                }
+            }
+        }
+
+        if(inverse){
+            const double scale = 1.0/((double)n2*n);
+            #pragma omp parallel for schedule(static) if(parallel)
+            for(long i = 0; i < n2*n; ++i) grid[i] *= scale;
+        }
+    }
+
+    private:
+
+    int n = 0;
+    vector<uint32_t> rev;
+    vector<complex<double>> twiddle;
+};
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef FMM_H
+#define FMM_H
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include <omp.h>
+#include "Gravity.h"
+#include "Octree.h"
+using namespace std;
+
+// Fast multipole self-gravity on the shared Morton octree.
+//
+// Multipole (M) and local (L) expansions in complex solid harmonics up to
+// degree `order`, stored as the m >= 0 half (the rest is conjugate).
+// Upward pass: P2M at leaves, M2M level by level. Interactions: dual tree
+// traversal; a cell pair with (Ri + Rj) < theta*|Xi - Xj| is M2L, two
+// leaves that fail that test are P2P, otherwise the larger cell is split.
+// Downward pass: L2L level by level, L2P at leaves. Cost is O(N) for a
+// fixed order; error falls roughly as theta^(order+1). Softening is only
+// applied in P2P, the far field is the plain 1/r potential.
+//
+// The traversal only records interaction lists; M2L and P2P then run per
+// target cell. Cell centres sit on a lattice, so an M2L offset measured
+// in half sizes of the smaller cell is an integer vector, and a few
+// thousand such vectors cover every far pair whatever N is. Their
+// r^-(n+1) Y_n^m kernels are built once and kept between calls, which
+// takes all trigonometry out of M2L. P2P walks the merged source ranges
+// of a leaf in float, with the blocked loop DirectGravity uses.
+//
+// M2L is still O(order^4) per pair and a cell has a few hundred of them
+// at theta = 0.5, so the direct sum wins on small clouds. On one thread
+// fmm_bench measures FMM at the order that matches Barnes-Hut accuracy
+// level with Direct at 20k fragments and 5x faster at 160k; it prints the
+// crossover for the machine it runs on.
+class FMMGravity{
+    public:
+
+    static const int maxOrder = 20;
+
+    int order = 4;
+    float theta = 0.5f;
+    float softening = 0.01f;    // Plummer softening on the P2P near field
+    Octree tree;
+
+    // Large leaves: a float P2P pair costs far less than the M2L work a
+    // deeper tree would add.
+    FMMGravity(){ tree.leafSize = 128; }
+
+    // Adds the self-gravity acceleration of every fragment to ax/ay/az.
+    void accumulate(FragmentSoA& fragments, bool parallel = true){
+        if(fragments.size() < 2) return;
+        setOrder(min(max(order, 0), maxOrder) + 1);
+        tree.build(fragments, parallel);
+
+        const size_t cells = tree.nodes.size();
+        const long n = (long)tree.size();
+        multipole.assign(cells*terms, complex<double>(0.0));
+        local.assign(cells*terms, complex<double>(0.0));
+        fx.assign(n, 0.0); fy.assign(n, 0.0); fz.assign(n, 0.0);
+        if(farList.size() < cells){
+            farList.resize(cells);
+            nearList.resize(cells);
+        }
+        for(size_t c = 0; c < cells; ++c){
+            farList[c].clear();
+            nearList[c].clear();
+        }
+
+        upwardPass(parallel);
+
+        if(parallel){
+            #pragma omp parallel
+            #pragma omp single
+            interact(0, 0, true);
+        } else {
+            interact(0, 0, false);
+        }
+        buildKernels(parallel);
+
+        #pragma omp parallel if(parallel)
+        {
+            vector<double> scratch(2*(kernelTerms + terms)*lanes);
+
+            #pragma omp for schedule(dynamic, 16)
+            for(long c = 0; c < (long)cells; ++c){
+                if(!farList[c].empty()) M2L((int)c, scratch.data());
+                if(!nearList[c].empty()) P2P((int)c);
+            }
+        }
+
+        downwardPass(parallel);
+
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long s = 0; s < n; ++s){
+            uint32_t f = tree.order[s];
+            fragments.ax[f] += (float)(G*fx[s]);
+            fragments.ay[f] += (float)(G*fy[s]);
+            fragments.az[f] += (float)(G*fz[s]);
+        }
+    }
+
+    private:
+
+    typedef complex<double> cplx;
+
+    // M2L kernels are tabulated for offsets up to kernelReach half sizes
+    // per axis; the rare pair beyond that builds its kernel on the spot.
+    static const int kernelReach = 24;
+    static const int kernelWidth = 2*kernelReach + 1;
+    static const int lanes = 8;     // sources per M2L batch
+
+    int P = 5;          // order + 1
+    int terms = 15;     // P*(P+1)/2 stored coefficients per cell
+    int kernelTerms = 55;   // P*(2P+1): degrees 0..2P-1, m >= 0
+    vector<cplx> multipole, local;
+    vector<double> fx, fy, fz;     // gradient of sum m/r, sorted order
+
+    vector<vector<pair<int, int>>> farList;    // per target: (source cell, kernel index)
+    vector<vector<int>> nearList;               // per target leaf: source leaves
+    vector<int> kernelSlot;         // kernel index -> slot in kernels, -1 if not built yet
+    vector<uint8_t> kernelWanted;   // set by the traversal for indices without a slot
+    vector<cplx> kernels;           // kernelTerms per slot
+
+    static double oddOrEven(int n){ return (n & 1) ? -1.0 : 1.0; }
+    static double ipow2n(int m){ return m >= 0 ? 1.0 : oddOrEven(m); }
+
+    cplx* M(int cell){ return &multipole[(size_t)cell*terms]; }
+    cplx* L(int cell){ return &local[(size_t)cell*terms]; }
+
+    double cellRadius(const OctreeNode& node) const { return 1.7320508075688772*node.halfSize; }
+
+    // The kernel table depends on the order, so it starts over when the
+    // order changes.
+    void setOrder(int newP){
+        if(newP == P && !kernelSlot.empty()) return;
+        P = newP;
+        terms = P*(P + 1)/2;
+        kernelTerms = P*(2*P + 1);
+        kernelSlot.assign(kernelWidth*kernelWidth*kernelWidth, -1);
+        kernelWanted.assign(kernelSlot.size(), 0);
+        kernels.clear();
+    }
+
+    static void cart2sph(double dx, double dy, double dz, double& r, double& theta, double& phi){
+        r = sqrt(dx*dx + dy*dy + dz*dz);
+        theta = r == 0.0 ? 0.0 : acos(max(-1.0, min(1.0, dz/r)));
+        phi = atan2(dy, dx);
+    }
+
+    // r^n Y_n^m (with the normalisation folded in) and its theta derivative.
+    void evalMultipole(double rho, double alpha, double beta, cplx* Ynm, cplx* YnmTheta) const {
+        double x = cos(alpha);
+        double y = sin(alpha);
+        double invY = y == 0.0 ? 0.0 : 1.0/y;
+        double fact = 1.0;
+        double pn = 1.0;
+        double rhom = 1.0;
+        cplx ei = exp(cplx(0.0, beta));
+        cplx eim = 1.0;
+        for(int m = 0; m < P; ++m){
+            double p = pn;
+            int npn = m*m + 2*m;
+            int nmn = m*m;
+            Ynm[npn] = rhom*p*eim;
+            Ynm[nmn] = conj(Ynm[npn]);
+            double p1 = p;
+            p = x*(2*m + 1)*p1;
+            YnmTheta[npn] = rhom*(p - (m + 1)*x*p1)*invY*eim;
+            rhom *= rho;
+            double rhon = rhom;
+            for(int n = m + 1; n < P; ++n){
+                int npm = n*n + n + m;
+                int nmm = n*n + n - m;
+                rhon /= -(n + m);
+                Ynm[npm] = rhon*p*eim;
+                Ynm[nmm] = conj(Ynm[npm]);
+                double p2 = p1;
+                p1 = p;
+                p = (x*(2*n + 1)*p1 - (n + m)*p2)/(n - m + 1);
+                YnmTheta[npm] = rhon*((n - m + 1)*p - (n + 1)*x*p1)*invY*eim;
+                rhon *= rho;
+            }
+            rhom /= -(2*m + 2)*(2*m + 1);
+            pn = -pn*fact*y;
+            fact += 2.0;
+            eim *= ei;
+        }
+    }
+
+    // r^-(n+1) Y_n^m up to degree count-1, used by M2L with count = 2P.
+    void evalLocal(double rho, double alpha, double beta, cplx* Ynm, int count) const {
+        double x = cos(alpha);
+        double y = sin(alpha);
+        double fact = 1.0;
+        double pn = 1.0;
+        double invR = -1.0/rho;
+        double rhom = -invR;
+        cplx ei = exp(cplx(0.0, beta));
+        cplx eim = 1.0;
+        for(int m = 0; m < count; ++m){
+            double p = pn;
+            int npn = m*m + 2*m;
+            int nmn = m*m;
+            Ynm[npn] = rhom*p*eim;
+            Ynm[nmn] = conj(Ynm[npn]);
+            double p1 = p;
+            p = x*(2*m + 1)*p1;
+            rhom *= invR;
+            double rhon = rhom;
+            for(int n = m + 1; n < count; ++n){
+                int npm = n*n + n + m;
+                int nmm = n*n + n - m;
+                Ynm[npm] = rhon*p*eim;
+                Ynm[nmm] = conj(Ynm[npm]);
+                double p2 = p1;
+                p1 = p;
+                p = (x*(2*n + 1)*p1 - (n + m)*p2)/(n - m + 1);
+                rhon *= invR*(n - m + 1);
+            }
+            pn = -pn*fact*y;
+            fact += 2.0;
+            eim *= ei;
+        }
+    }
+
+    // The M2L kernel for offset (dx, dy, dz), m >= 0 half only.
+    void localKernel(double dx, double dy, double dz, cplx* kernel) const {
+        cplx Ynm2[4*(maxOrder + 1)*(maxOrder + 1)];
+        double rho, alpha, beta;
+        cart2sph(dx, dy, dz, rho, alpha, beta);
+        evalLocal(rho, alpha, beta, Ynm2, 2*P);
+        for(int n = 0; n < 2*P; ++n)
+            for(int m = 0; m <= n; ++m)
+                kernel[n*(n + 1)/2 + m] = Ynm2[n*n + n + m];
+    }
+
+    // ---------------- Upward pass ----------------
+
+    void P2M(int cell){
+        const OctreeNode& node = tree.nodes[cell];
+        cplx Ynm[(maxOrder + 1)*(maxOrder + 1)], YnmTheta[(maxOrder + 1)*(maxOrder + 1)];
+        cplx* Mc = M(cell);
+        for(int s = node.begin; s < node.end; ++s){
+            double rho, alpha, beta;
+            cart2sph(tree.x[s] - node.cx, tree.y[s] - node.cy, tree.z[s] - node.cz, rho, alpha, beta);
+            evalMultipole(rho, alpha, -beta, Ynm, YnmTheta);
+            for(int n = 0; n < P; ++n)
+                for(int m = 0; m <= n; ++m)
+                    Mc[n*(n + 1)/2 + m] += (double)tree.m[s]*Ynm[n*n + n + m];
+        }
+    }
+
+    void M2M(int cell){
+        const OctreeNode& parent = tree.nodes[cell];
+        cplx Ynm[(maxOrder + 1)*(maxOrder + 1)], YnmTheta[(maxOrder + 1)*(maxOrder + 1)];
+        cplx* Mi = M(cell);
+        for(int c = parent.firstChild; c < parent.firstChild + parent.childCount; ++c){
+            const OctreeNode& child = tree.nodes[c];
+            const cplx* Mj = M(c);
+            double rho, alpha, beta;
+            cart2sph(parent.cx - child.cx, parent.cy - child.cy, parent.cz - child.cz, rho, alpha, beta);
+            evalMultipole(rho, alpha, beta, Ynm, YnmTheta);
+            for(int j = 0; j < P; ++j){
+                for(int k = 0; k <= j; ++k){
+                    cplx sum = 0.0;
+                    for(int n = 0; n <= j; ++n){
+                        for(int m = max(-n, -j + k + n); m <= min(k - 1, n); ++m){
+                            int jnkms = (j - n)*(j - n + 1)/2 + k - m;
+                            sum += Mj[jnkms]*Ynm[n*n + n - m]*(ipow2n(m)*oddOrEven(n));
+                        }
+                        for(int m = k; m <= min(n, j + k - n); ++m){
+                            int jnkms = (j - n)*(j - n + 1)/2 - k + m;
+                            sum += conj(Mj[jnkms])*Ynm[n*n + n - m]*oddOrEven(k + n + m);
+                        }
+                    }
+                    Mi[j*(j + 1)/2 + k] += sum;
+                }
+            }
+        }
+    }
+
+    void upwardPass(bool parallel){
+        for(int level = (int)tree.levels.size() - 1; level >= 0; --level){
+            const vector<int>& ids = tree.levels[level];
+            #pragma omp parallel for schedule(dynamic, 16) if(parallel)
+            for(long k = 0; k < (long)ids.size(); ++k){
+                if(tree.isLeaf(tree.nodes[ids[k]])) P2M(ids[k]);
+                else M2M(ids[k]);
+            }
+        }
+    }
+
+    // ---------------- Interactions ----------------
+
+    // Index of the offset between two cell centres in the kernel table, or
+    // -1 if it is out of reach. Missing kernels are flagged for buildKernels.
+    int kernelIndex(const OctreeNode& ci, const OctreeNode& cj){
+        const float h = min(ci.halfSize, cj.halfSize);
+        const long kx = lround((ci.cx - cj.cx)/h), ky = lround((ci.cy - cj.cy)/h), kz = lround((ci.cz - cj.cz)/h);
+        if(labs(kx) > kernelReach || labs(ky) > kernelReach || labs(kz) > kernelReach) return -1;
+        const int index = (int)(((kx + kernelReach)*kernelWidth + ky + kernelReach)*kernelWidth + kz + kernelReach);
+        if(kernelSlot[index] < 0){
+            #pragma omp atomic write
+            kernelWanted[index] = 1;
+        }
+        return index;
+    }
+
+    void buildKernels(bool parallel){
+        vector<int> added;
+        int slots = (int)(kernels.size()/kernelTerms);
+        for(int index = 0; index < (int)kernelSlot.size(); ++index){
+            if(!kernelWanted[index]) continue;
+            kernelWanted[index] = 0;
+            kernelSlot[index] = slots++;
+            added.push_back(index);
+        }
+        if(added.empty()) return;
+        kernels.resize((size_t)slots*kernelTerms);
+
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long a = 0; a < (long)added.size(); ++a){
+            const int index = added[a];
+            const int kx = index/(kernelWidth*kernelWidth) - kernelReach;
+            const int ky = index/kernelWidth%kernelWidth - kernelReach;
+            const int kz = index%kernelWidth - kernelReach;
+            localKernel(kx, ky, kz, &kernels[(size_t)kernelSlot[index]*kernelTerms]);
+        }
+    }
+
+    // Far field of one target cell, `lanes` sources at a time. Every
+    // source goes through the same index pattern, so the innermost loops
+    // run across sources and vectorize without gathers. The kernel is
+    // tabulated for the offset in units of h, the smaller half size;
+    // degree l scales as h^-(l+1), split as h^-n on the multipole and
+    // h^-(j+1) on the result. scratch holds 2*(kernelTerms + terms)*lanes
+    // doubles.
+    void M2L(int target, double* scratch){
+        const OctreeNode& ci = tree.nodes[target];
+        const vector<pair<int, int>>& sources = farList[target];
+        double* yr = scratch;
+        double* yi = yr + kernelTerms*lanes;
+        double* mr = yi + kernelTerms*lanes;
+        double* mi = mr + terms*lanes;
+        cplx buffer[(2*maxOrder + 2)*(2*maxOrder + 3)/2];
+        double invH[lanes], scale[lanes];
+        cplx* Li = L(target);
+
+        for(size_t first = 0; first < sources.size(); first += lanes){
+            for(int l = 0; l < lanes; ++l){
+                if(first + l >= sources.size()){
+                    for(int t = 0; t < kernelTerms; ++t) yr[t*lanes + l] = yi[t*lanes + l] = 0.0;
+                    for(int t = 0; t < terms; ++t) mr[t*lanes + l] = mi[t*lanes + l] = 0.0;
+                    invH[l] = 1.0;
+                    continue;
+                }
+                const int source = sources[first + l].first, index = sources[first + l].second;
+                const OctreeNode& cj = tree.nodes[source];
+                const double h = min(ci.halfSize, cj.halfSize);
+                const cplx* Y = buffer;
+                if(index >= 0) Y = &kernels[(size_t)kernelSlot[index]*kernelTerms];
+                else localKernel((ci.cx - cj.cx)/h, (ci.cy - cj.cy)/h, (ci.cz - cj.cz)/h, buffer);
+                for(int t = 0; t < kernelTerms; ++t){
+                    yr[t*lanes + l] = real(Y[t]);
+                    yi[t*lanes + l] = imag(Y[t]);
+                }
+                invH[l] = 1.0/h;
+                const cplx* Mj = M(source);
+                double s = 1.0;
+                for(int n = 0; n < P; ++n){
+                    for(int t = n*(n + 1)/2; t <= n*(n + 1)/2 + n; ++t){
+                        mr[t*lanes + l] = real(Mj[t])*s;
+                        mi[t*lanes + l] = imag(Mj[t])*s;
+                    }
+                    s *= invH[l];
+                }
+            }
+
+            for(int l = 0; l < lanes; ++l) scale[l] = invH[l];
+            for(int j = 0; j < P; ++j){
+                for(int k = 0; k <= j; ++k){
+                    double re[lanes] = {}, im[lanes] = {};
+                    for(int n = 0; n < P; ++n){
+                        const double* Mr = mr + n*(n + 1)/2*lanes;
+                        const double* Mi = mi + n*(n + 1)/2*lanes;
+                        const double* Yr = yr + (j + n)*(j + n + 1)/2*lanes;
+                        const double* Yi = yi + (j + n)*(j + n + 1)/2*lanes;
+                        // m < 0: conj(M_n^|m| Y_{j+n}^{k+|m|})
+                        for(int a = 1; a <= n; ++a){
+                            const int u = a*lanes, v = (k + a)*lanes;
+                            #pragma omp simd
+                            for(int l = 0; l < lanes; ++l){
+                                re[l] += Mr[u + l]*Yr[v + l] - Mi[u + l]*Yi[v + l];
+                                im[l] -= Mr[u + l]*Yi[v + l] + Mi[u + l]*Yr[v + l];
+                            }
+                        }
+                        // 0 <= m < k: (-1)^m M_n^m conj(Y_{j+n}^{k-m})
+                        for(int m = 0; m < k && m <= n; ++m){
+                            const double s = oddOrEven(m);
+                            const int u = m*lanes, v = (k - m)*lanes;
+                            #pragma omp simd
+                            for(int l = 0; l < lanes; ++l){
+                                re[l] += s*(Mr[u + l]*Yr[v + l] + Mi[u + l]*Yi[v + l]);
+                                im[l] += s*(Mi[u + l]*Yr[v + l] - Mr[u + l]*Yi[v + l]);
+                            }
+                        }
+                        // m >= k: (-1)^k M_n^m Y_{j+n}^{m-k}
+                        const double s = oddOrEven(k);
+                        for(int m = k; m <= n; ++m){
+                            const int u = m*lanes, v = (m - k)*lanes;
+                            #pragma omp simd
+                            for(int l = 0; l < lanes; ++l){
+                                re[l] += s*(Mr[u + l]*Yr[v + l] - Mi[u + l]*Yi[v + l]);
+                                im[l] += s*(Mr[u + l]*Yi[v + l] + Mi[u + l]*Yr[v + l]);
+                            }
+                        }
+                    }
+                    double sumRe = 0.0, sumIm = 0.0;
+                    for(int l = 0; l < lanes; ++l){
+                        sumRe += re[l]*scale[l];
+                        sumIm += im[l]*scale[l];
+                    }
+                    Li[j*(j + 1)/2 + k] += cplx(sumRe, sumIm)*oddOrEven(j);
+                }
+                for(int l = 0; l < lanes; ++l) scale[l] *= invH[l];
+            }
+        }
+    }
+
+    // All near sources of a target leaf: adjacent leaves are merged into
+    // one range, then each range is a tile that the leaf's fragments sweep
+    // in float while it sits in L1, with double sums across tiles.
+    void P2P(int target){
+        const OctreeNode& ci = tree.nodes[target];
+        vector<int>& sources = nearList[target];
+        sort(sources.begin(), sources.end(), [&](int a, int b){ return tree.nodes[a].begin < tree.nodes[b].begin; });
+
+        const float* px = tree.x.data();
+        const float* py = tree.y.data();
+        const float* pz = tree.z.data();
+        const float* mass = tree.m.data();
+        const float eps2 = softening*softening;
+        size_t next = 0;
+        while(next < sources.size()){
+            const int jBegin = tree.nodes[sources[next]].begin;
+            int jEnd = tree.nodes[sources[next]].end;
+            for(++next; next < sources.size() && tree.nodes[sources[next]].begin == jEnd; ++next)
+                jEnd = tree.nodes[sources[next]].end;
+
+            for(int i = ci.begin; i < ci.end; ++i){
+                const float xi = px[i], yi = py[i], zi = pz[i];
+                float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                #pragma omp simd reduction(+:ax,ay,az)
+                for(int j = jBegin; j < jEnd; ++j){
+                    float dx = px[j] - xi, dy = py[j] - yi, dz = pz[j] - zi;
+                    float r2 = dx*dx + dy*dy + dz*dz + eps2;
+                    float inv = 1.0f/sqrtf(r2);
+                    float w = j == i ? 0.0f : mass[j]*inv*inv*inv;
+                    ax += w*dx; ay += w*dy; az += w*dz;
+                }
+                fx[i] += ax; fy[i] += ay; fz[i] += az;
+            }
+        }
+    }
+
+    // Only targets are split into tasks, so two tasks never write the
+    // same cell's interaction lists.
+    void interact(int target, int source, bool spawn){
+        const OctreeNode& ci = tree.nodes[target];
+        const OctreeNode& cj = tree.nodes[source];
+        double dx = ci.cx - cj.cx, dy = ci.cy - cj.cy, dz = ci.cz - cj.cz;
+        double ri = cellRadius(ci), rj = cellRadius(cj);
+        double separation2 = (dx*dx + dy*dy + dz*dz)*theta*theta;
+
+        if(separation2 > (ri + rj)*(ri + rj)){
+            farList[target].emplace_back(source, kernelIndex(ci, cj));
+        } else if(tree.isLeaf(ci) && tree.isLeaf(cj)){
+            nearList[target].push_back(source);
+        } else if(tree.isLeaf(cj) || (ri >= rj && !tree.isLeaf(ci))){
+            for(int c = ci.firstChild; c < ci.firstChild + ci.childCount; ++c){
+                #pragma omp task if(spawn && tree.nodes[c].end - tree.nodes[c].begin > 512)
+                interact(c, source, spawn);
+            }
+            #pragma omp taskwait
+        } else {
+            for(int c = cj.firstChild; c < cj.firstChild + cj.childCount; ++c)
+                interact(target, c, spawn);
+        }
+    }
+
+    // ---------------- Downward pass ----------------
+
+    void L2L(int cell){
+        const OctreeNode& parent = tree.nodes[cell];
+        cplx Ynm[(maxOrder + 1)*(maxOrder + 1)], YnmTheta[(maxOrder + 1)*(maxOrder + 1)];
+        const cplx* Lj = L(cell);
+        for(int c = parent.firstChild; c < parent.firstChild + parent.childCount; ++c){
+            const OctreeNode& child = tree.nodes[c];
+            cplx* Li = L(c);
+            double rho, alpha, beta;
+            cart2sph(child.cx - parent.cx, child.cy - parent.cy, child.cz - parent.cz, rho, alpha, beta);
+            evalMultipole(rho, alpha, beta, Ynm, YnmTheta);
+            for(int j = 0; j < P; ++j){
+                for(int k = 0; k <= j; ++k){
+                    cplx sum = 0.0;
+                    for(int n = j; n < P; ++n){
+                        for(int m = j + k - n; m < 0; ++m){
+                            int jnkm = (n - j)*(n - j) + n - j + m - k;
+                            sum += conj(Lj[n*(n + 1)/2 - m])*Ynm[jnkm]*oddOrEven(k);
+                        }
+                        for(int m = 0; m <= n; ++m){
+                            if(n - j >= abs(m - k)){
+                                int jnkm = (n - j)*(n - j) + n - j + m - k;
+                                sum += Lj[n*(n + 1)/2 + m]*Ynm[jnkm]*oddOrEven((m - k)*(m < k));
+                            }
+                        }
+                    }
+                    Li[j*(j + 1)/2 + k] += sum;
+                }
+            }
+        }
+    }
+
+    void L2P(int cell){
+        const OctreeNode& node = tree.nodes[cell];
+        cplx Ynm[(maxOrder + 1)*(maxOrder + 1)], YnmTheta[(maxOrder + 1)*(maxOrder + 1)];
+        const cplx* Lc = L(cell);
+        const cplx I(0.0, 1.0);
+        for(int s = node.begin; s < node.end; ++s){
+            double r, theta, phi;
+            cart2sph(tree.x[s] - node.cx, tree.y[s] - node.cy, tree.z[s] - node.cz, r, theta, phi);
+            if(r == 0.0) continue;
+            evalMultipole(r, theta, phi, Ynm, YnmTheta);
+            double gr = 0.0, gt = 0.0, gp = 0.0;
+            for(int n = 0; n < P; ++n){
+                int nm = n*n + n;
+                int nms = n*(n + 1)/2;
+                gr += real(Lc[nms]*Ynm[nm])/r*n;
+                gt += real(Lc[nms]*YnmTheta[nm]);
+                for(int m = 1; m <= n; ++m){
+                    nm = n*n + n + m;
+                    nms = n*(n + 1)/2 + m;
+                    gr += 2.0*real(Lc[nms]*Ynm[nm])/r*n;
+                    gt += 2.0*real(Lc[nms]*YnmTheta[nm]);
+                    gp += 2.0*real(Lc[nms]*Ynm[nm]*I)*m;
+                }
+            }
+            double st = sin(theta), ct = cos(theta), sp = sin(phi), cp = cos(phi);
+            double invSt = st == 0.0 ? 0.0 : 1.0/st;
+            fx[s] += st*cp*gr + ct*cp/r*gt - sp/r*invSt*gp;
+            fy[s] += st*sp*gr + ct*sp/r*gt + cp/r*invSt*gp;
+            fz[s] += ct*gr - st/r*gt;
+        }
+    }
+
+    void downwardPass(bool parallel){
+        for(int level = 0; level < (int)tree.levels.size(); ++level){
+            const vector<int>& ids = tree.levels[level];
+            #pragma omp parallel for schedule(dynamic, 16) if(parallel)
+            for(long k = 0; k < (long)ids.size(); ++k){
+                if(tree.isLeaf(tree.nodes[ids[k]])) L2P(ids[k]);
+                else L2L(ids[k]);
+            }
+        }
+    }
+};
+
+#endif
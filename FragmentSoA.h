@@ -0,0 +1,115 @@
+#ifndef FRAGMENTSOA_H
+#define FRAGMENTSOA_H
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Body.h"
+using namespace std;
+
+// Allocator handing out cache-line aligned blocks, so every FragmentSoA
+// array starts on a boundary that is valid for 128/256/512-bit loads.
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind{ using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&){}
+
+    T* allocate(size_t n){
+        return static_cast<T*>(::operator new(n*sizeof(T), align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t){
+        ::operator delete(p, align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template<typename T>
+using aligned_vector = vector<T, AlignedAllocator<T>>;
+
+// Structure-of-arrays fragment store used by the post-breakup update.
+// Each component lives in its own contiguous array so the gravity loops
+// stream through memory with unit stride; Body views are built on demand
+// for rendering and for code that still wants the AoS type.
+// ax/ay/az are scratch space written by the force pass each step;
+// accelerationCurrent says they still match the positions, which lets
+// the leapfrog integrator reuse them at the start of the next step.
+class FragmentSoA{
+    public:
+
+    aligned_vector<float> px, py, pz;
+    aligned_vector<float> vx, vy, vz;
+    aligned_vector<float> mass;
+    aligned_vector<float> ax, ay, az;
+    bool accelerationCurrent = false;
+
+    size_t size() const { return mass.size(); }
+    bool empty() const { return mass.empty(); }
+
+    void reserve(size_t n){
+        px.reserve(n); py.reserve(n); pz.reserve(n);
+        vx.reserve(n); vy.reserve(n); vz.reserve(n);
+        mass.reserve(n);
+        ax.reserve(n); ay.reserve(n); az.reserve(n);
+    }
+
+    // Grows or shrinks every array to n entries; new entries are zero.
+    void resize(size_t n){
+        px.resize(n); py.resize(n); pz.resize(n);
+        vx.resize(n); vy.resize(n); vz.resize(n);
+        mass.resize(n);
+        ax.resize(n); ay.resize(n); az.resize(n);
+        accelerationCurrent = false;
+    }
+
+    void clear(){
+        px.clear(); py.clear(); pz.clear();
+        vx.clear(); vy.clear(); vz.clear();
+        mass.clear();
+        ax.clear(); ay.clear(); az.clear();
+        accelerationCurrent = false;
+    }
+
+    void emplace_back(glm::vec3 pos, glm::vec3 vel, float m){
+        px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+        vx.push_back(vel.x); vy.push_back(vel.y); vz.push_back(vel.z);
+        mass.push_back(m);
+        ax.push_back(0.0f); ay.push_back(0.0f); az.push_back(0.0f);
+        accelerationCurrent = false;
+    }
+
+    void push_back(const Body& b){
+        emplace_back(b.position, b.velocity, b.mass);
+    }
+
+    glm::vec3 position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+    glm::vec3 velocity(size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+
+    Body body(size_t i) const { return Body(position(i), velocity(i), mass[i]); }
+
+    void setBody(size_t i, const Body& b){
+        px[i] = b.position.x; py[i] = b.position.y; pz[i] = b.position.z;
+        vx[i] = b.velocity.x; vy[i] = b.velocity.y; vz[i] = b.velocity.z;
+        mass[i] = b.mass;
+        accelerationCurrent = false;
+    }
+
+    vector<Body> toBodies() const {
+        vector<Body> bodies;
+        bodies.reserve(size());
+        for(size_t i = 0; i < size(); ++i)
+            bodies.push_back(body(i));
+        return bodies;
+    }
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRUSTUMCULL_H
+#define FRUSTUMCULL_H
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+using namespace std;
+
+// View frustum as six inward-facing planes (a, b, c, d): a point p is
+// inside a plane when a*p.x + b*p.y + c*p.z + d >= 0.
+struct Frustum{
+    float a[6], b[6], c[6], d[6];
+
+    // Gribb-Hartmann extraction from a projection * view matrix. Planes are
+    // normalised so plane distances are in world units.
+    static Frustum fromMatrix(const glm::mat4& m){
+        Frustum f;
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        const glm::vec4 planes[6] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+        for(int k = 0; k < 6; ++k){
+            float length = sqrtf(planes[k].x*planes[k].x + planes[k].y*planes[k].y + planes[k].z*planes[k].z);
+            float inv = length > 0.0f ? 1.0f/length : 0.0f;
+            f.a[k] = planes[k].x*inv; f.b[k] = planes[k].y*inv;
+            f.c[k] = planes[k].z*inv; f.d[k] = planes[k].w*inv;
+        }
+        return f;
+    }
+};
+
+// Flags the spheres of the given radius that touch the frustum, at the
+// positions interpolated between previous and current by alpha, and
+// returns how many are visible. The interpolated positions are written to
+// `positions` so drawing does not compute them again. Positions come in
+// as one slice per axis and the loop is branch-free, so it vectorizes
+// across fragments.
+inline size_t cullSpheres(const Frustum& frustum, const float* previousX, const float* previousY, const float* previousZ,
+                          const float* currentX, const float* currentY, const float* currentZ,
+                          float alpha, size_t count, float radius, glm::vec3* positions, unsigned char* visible){
+    if(count == 0) return 0;
+    size_t visibleCount = 0;
+    #pragma omp simd reduction(+:visibleCount)
+    for(size_t i = 0; i < count; ++i){
+        float x = previousX[i] + (currentX[i] - previousX[i])*alpha;
+        float y = previousY[i] + (currentY[i] - previousY[i])*alpha;
+        float z = previousZ[i] + (currentZ[i] - previousZ[i])*alpha;
+        positions[i].x = x; positions[i].y = y; positions[i].z = z;
+        bool inside = true;
+        for(int k = 0; k < 6; ++k)
+            inside &= frustum.a[k]*x + frustum.b[k]*y + frustum.c[k]*z + frustum.d[k] >= -radius;
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GLEXTENSIONS_H
+#define GLEXTENSIONS_H
+
+#include <glad/glad.h>
+#include <cstring>
+
+// The bundled loader only covers GL 3.3 core. The few newer entry points
+// the renderer can use are declared here and loaded at runtime; each stays
+// null when the context cannot provide it, and callers fall back to the
+// 3.3 path.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef void (APIENTRYP PFNEXTBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFNEXTMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect,
+                                                             GLsizei drawcount, GLsizei stride);
+
+struct GLExtensions {
+    PFNEXTBUFFERSTORAGEPROC bufferStorage = nullptr;                    // GL 4.4 / ARB_buffer_storage
+    PFNEXTMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = nullptr;  // GL 4.3, with base instance
+};
+
+inline GLExtensions& glExtensions() {
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0) return true;
+    }
+    return false;
+}
+
+inline bool hasGLVersion(int major, int minor) {
+    return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+// Call once after gladLoadGLLoader.
+inline void loadGLExtensions(GLADloadproc load) {
+    GLExtensions& ext = glExtensions();
+    if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+        ext.bufferStorage = (PFNEXTBUFFERSTORAGEPROC)load("glBufferStorage");
+    // Indirect commands only honour baseInstance from GL 4.2 / ARB_base_instance.
+    if (hasGLVersion(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")))
+        ext.multiDrawElementsIndirect = (PFNEXTMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+}
+
+#endif
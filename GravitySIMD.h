@@ -0,0 +1,315 @@
+#ifndef GRAVITYSIMD_H
+#define GRAVITYSIMD_H
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <omp.h>
+#include <glm/glm.hpp>
+#include "FragmentSoA.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GRAVITY_SIMD_X86 1
+#endif
+using namespace std;
+
+// Central-body acceleration kernels for the fragment store.
+//
+//     a = GM * d * rinv^3,   d = center - p,   rinv ~ 1/|d|
+//
+// rinv comes from the hardware reciprocal square root estimate refined by
+// one Newton step. Every vector kernel has a scalar twin that performs the
+// same operations in the same order with the same estimate instruction, so
+// kernelFor(level) and the scalar path for that level agree bit for bit.
+// Contraction into FMA is disabled below; it would break that property.
+
+#if defined(__clang__)
+#define GRAVITY_SIMD_NO_CONTRACT _Pragma("clang fp contract(off)")
+#else
+#define GRAVITY_SIMD_NO_CONTRACT
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+enum class SimdLevel{ Scalar, SSE, AVX2, AVX512 };
+
+inline const char* simdLevelName(SimdLevel level){
+    switch(level){
+        case SimdLevel::SSE:    return "SSE";
+        case SimdLevel::AVX2:   return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+        default:                return "scalar";
+    }
+}
+
+// Best level the running CPU supports.
+inline SimdLevel detectSimdLevel(){
+#ifdef GRAVITY_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if(__builtin_cpu_supports("avx2"))    return SimdLevel::AVX2;
+    return SimdLevel::SSE;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+struct CentralPull{
+    float cx, cy, cz;
+    float GM;
+};
+
+typedef void (*CentralAccelKernel)(const float* px, const float* py, const float* pz,
+                                   float* ax, float* ay, float* az,
+                                   size_t n, const CentralPull& pull);
+
+// ---------------- Scalar reference ----------------
+
+// One Newton-Raphson step on y0 ~ 1/sqrt(r2).
+inline float refineRsqrt(float r2, float y0){
+    GRAVITY_SIMD_NO_CONTRACT
+    float h = 0.5f*r2;
+    float t = h*y0;
+    t = t*y0;
+    t = 1.5f - t;
+    return y0*t;
+}
+
+inline void centralAccelerationOne(float x, float y, float z, float y0Source(float),
+                                   const CentralPull& pull, float& ax, float& ay, float& az){
+    GRAVITY_SIMD_NO_CONTRACT
+    float dx = pull.cx - x;
+    float dy = pull.cy - y;
+    float dz = pull.cz - z;
+    float r2 = dx*dx;
+    r2 = r2 + dy*dy;
+    r2 = r2 + dz*dz;
+    float rinv = refineRsqrt(r2, y0Source(r2));
+    float rinv3 = rinv*rinv;
+    rinv3 = rinv3*rinv;
+    float s = pull.GM*rinv3;
+    ax = dx*s;
+    ay = dy*s;
+    az = dz*s;
+}
+
+inline float rsqrtEstimateExact(float r2){ return 1.0f/sqrtf(r2); }
+
+inline void centralAccelerationScalarExact(const float* px, const float* py, const float* pz,
+                                           float* ax, float* ay, float* az,
+                                           size_t n, const CentralPull& pull){
+    for(size_t i = 0; i < n; ++i)
+        centralAccelerationOne(px[i], py[i], pz[i], rsqrtEstimateExact, pull, ax[i], ay[i], az[i]);
+}
+
+#ifdef GRAVITY_SIMD_X86
+
+inline float rsqrtEstimateSSE(float r2){
+    return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(r2)));
+}
+
+__attribute__((target("avx512f")))
+inline float rsqrtEstimateAVX512(float r2){
+    return _mm_cvtss_f32(_mm_rsqrt14_ss(_mm_setzero_ps(), _mm_set_ss(r2)));
+}
+
+// Scalar twin of the SSE and AVX2 kernels (rsqrtss/rsqrtps share one table).
+inline void centralAccelerationScalarSSE(const float* px, const float* py, const float* pz,
+                                         float* ax, float* ay, float* az,
+                                         size_t n, const CentralPull& pull){
+    for(size_t i = 0; i < n; ++i)
+        centralAccelerationOne(px[i], py[i], pz[i], rsqrtEstimateSSE, pull, ax[i], ay[i], az[i]);
+}
+
+// Scalar twin of the AVX-512 kernel (vrsqrt14ss/vrsqrt14ps).
+__attribute__((target("avx512f")))
+inline void centralAccelerationScalarAVX512(const float* px, const float* py, const float* pz,
+                                            float* ax, float* ay, float* az,
+                                            size_t n, const CentralPull& pull){
+    GRAVITY_SIMD_NO_CONTRACT
+    for(size_t i = 0; i < n; ++i){
+        float dx = pull.cx - px[i];
+        float dy = pull.cy - py[i];
+        float dz = pull.cz - pz[i];
+        float r2 = dx*dx;
+        r2 = r2 + dy*dy;
+        r2 = r2 + dz*dz;
+        float rinv = refineRsqrt(r2, rsqrtEstimateAVX512(r2));
+        float rinv3 = rinv*rinv;
+        rinv3 = rinv3*rinv;
+        float s = pull.GM*rinv3;
+        ax[i] = dx*s;
+        ay[i] = dy*s;
+        az[i] = dz*s;
+    }
+}
+
+// ---------------- Vector kernels ----------------
+
+inline void centralAccelerationSSE(const float* px, const float* py, const float* pz,
+                                   float* ax, float* ay, float* az,
+                                   size_t n, const CentralPull& pull){
+    const __m128 cx = _mm_set1_ps(pull.cx), cy = _mm_set1_ps(pull.cy), cz = _mm_set1_ps(pull.cz);
+    const __m128 gm = _mm_set1_ps(pull.GM);
+    const __m128 half = _mm_set1_ps(0.5f), threeHalves = _mm_set1_ps(1.5f);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(px + i));
+        __m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(py + i));
+        __m128 dz = _mm_sub_ps(cz, _mm_loadu_ps(pz + i));
+        __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 y0 = _mm_rsqrt_ps(r2);
+        __m128 t = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, r2), y0), y0);
+        __m128 rinv = _mm_mul_ps(y0, _mm_sub_ps(threeHalves, t));
+        __m128 s = _mm_mul_ps(gm, _mm_mul_ps(_mm_mul_ps(rinv, rinv), rinv));
+        _mm_storeu_ps(ax + i, _mm_mul_ps(dx, s));
+        _mm_storeu_ps(ay + i, _mm_mul_ps(dy, s));
+        _mm_storeu_ps(az + i, _mm_mul_ps(dz, s));
+    }
+    centralAccelerationScalarSSE(px + i, py + i, pz + i, ax + i, ay + i, az + i, n - i, pull);
+}
+
+__attribute__((target("avx2")))
+inline void centralAccelerationAVX2(const float* px, const float* py, const float* pz,
+                                    float* ax, float* ay, float* az,
+                                    size_t n, const CentralPull& pull){
+    const __m256 cx = _mm256_set1_ps(pull.cx), cy = _mm256_set1_ps(pull.cy), cz = _mm256_set1_ps(pull.cz);
+    const __m256 gm = _mm256_set1_ps(pull.GM);
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256 dx = _mm256_sub_ps(cx, _mm256_loadu_ps(px + i));
+        __m256 dy = _mm256_sub_ps(cy, _mm256_loadu_ps(py + i));
+        __m256 dz = _mm256_sub_ps(cz, _mm256_loadu_ps(pz + i));
+        __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        __m256 y0 = _mm256_rsqrt_ps(r2);
+        __m256 t = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, r2), y0), y0);
+        __m256 rinv = _mm256_mul_ps(y0, _mm256_sub_ps(threeHalves, t));
+        __m256 s = _mm256_mul_ps(gm, _mm256_mul_ps(_mm256_mul_ps(rinv, rinv), rinv));
+        _mm256_storeu_ps(ax + i, _mm256_mul_ps(dx, s));
+        _mm256_storeu_ps(ay + i, _mm256_mul_ps(dy, s));
+        _mm256_storeu_ps(az + i, _mm256_mul_ps(dz, s));
+    }
+    centralAccelerationScalarSSE(px + i, py + i, pz + i, ax + i, ay + i, az + i, n - i, pull);
+}
+
+__attribute__((target("avx512f")))
+inline void centralAccelerationAVX512(const float* px, const float* py, const float* pz,
+                                      float* ax, float* ay, float* az,
+                                      size_t n, const CentralPull& pull){
+    const __m512 cx = _mm512_set1_ps(pull.cx), cy = _mm512_set1_ps(pull.cy), cz = _mm512_set1_ps(pull.cz);
+    const __m512 gm = _mm512_set1_ps(pull.GM);
+    const __m512 half = _mm512_set1_ps(0.5f), threeHalves = _mm512_set1_ps(1.5f);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m512 dx = _mm512_sub_ps(cx, _mm512_loadu_ps(px + i));
+        __m512 dy = _mm512_sub_ps(cy, _mm512_loadu_ps(py + i));
+        __m512 dz = _mm512_sub_ps(cz, _mm512_loadu_ps(pz + i));
+        __m512 r2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+        __m512 y0 = _mm512_maskz_rsqrt14_ps((__mmask16)0xFFFF, r2);
+        __m512 t = _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(half, r2), y0), y0);
+        __m512 rinv = _mm512_mul_ps(y0, _mm512_sub_ps(threeHalves, t));
+        __m512 s = _mm512_mul_ps(gm, _mm512_mul_ps(_mm512_mul_ps(rinv, rinv), rinv));
+        _mm512_storeu_ps(ax + i, _mm512_mul_ps(dx, s));
+        _mm512_storeu_ps(ay + i, _mm512_mul_ps(dy, s));
+        _mm512_storeu_ps(az + i, _mm512_mul_ps(dz, s));
+    }
+    centralAccelerationScalarAVX512(px + i, py + i, pz + i, ax + i, ay + i, az + i, n - i, pull);
+}
+
+#endif // GRAVITY_SIMD_X86
+
+// ---------------- Dispatch ----------------
+
+// Vector kernel for a level; SimdLevel::Scalar selects the exact 1/sqrt path.
+inline CentralAccelKernel kernelFor(SimdLevel level){
+#ifdef GRAVITY_SIMD_X86
+    switch(level){
+        case SimdLevel::AVX512: return centralAccelerationAVX512;
+        case SimdLevel::AVX2:   return centralAccelerationAVX2;
+        case SimdLevel::SSE:    return centralAccelerationSSE;
+        default: break;
+    }
+#endif
+    (void)level;
+    return centralAccelerationScalarExact;
+}
+
+// Scalar reference with the same estimate instruction as kernelFor(level).
+inline CentralAccelKernel referenceKernelFor(SimdLevel level){
+#ifdef GRAVITY_SIMD_X86
+    switch(level){
+        case SimdLevel::AVX512: return centralAccelerationScalarAVX512;
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE:    return centralAccelerationScalarSSE;
+        default: break;
+    }
+#endif
+    (void)level;
+    return centralAccelerationScalarExact;
+}
+
+// Level used by computeCentralAcceleration. Detected once; can be lowered
+// (e.g. to compare paths) but is clamped to what the CPU supports.
+inline SimdLevel& activeSimdLevel(){
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+inline void setSimdLevel(SimdLevel level){
+    SimdLevel best = detectSimdLevel();
+    activeSimdLevel() = (int)level > (int)best ? best : level;
+}
+
+// Fills fragments.ax/ay/az with the pull of a body of mass GM/G at center.
+// The parallel path hands each thread whole cache-line aligned chunks.
+inline void computeCentralAcceleration(FragmentSoA& fragments, glm::vec3 center, float GM, bool parallel = true){
+    const size_t n = fragments.size();
+    const CentralPull pull{center.x, center.y, center.z, GM};
+    const CentralAccelKernel kernel = kernelFor(activeSimdLevel());
+    const size_t chunk = 4096;
+    const long chunks = (long)((n + chunk - 1)/chunk);
+
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(long c = 0; c < chunks; ++c){
+        size_t begin = (size_t)c*chunk;
+        size_t count = begin + chunk < n ? chunk : n - begin;
+        kernel(fragments.px.data() + begin, fragments.py.data() + begin, fragments.pz.data() + begin,
+               fragments.ax.data() + begin, fragments.ay.data() + begin, fragments.az.data() + begin,
+               count, pull);
+    }
+}
+
+// Same, for the listed fragments only; the others are left untouched. The
+// positions are gathered into short batches so the SIMD kernel still
+// runs, and each result is bit-identical to the full pass.
+inline void computeCentralAcceleration(FragmentSoA& fragments, const vector<uint32_t>& active, glm::vec3 center, float GM,
+                                       bool parallel = true){
+    const long count = (long)active.size();
+    const CentralPull pull{center.x, center.y, center.z, GM};
+    const CentralAccelKernel kernel = kernelFor(activeSimdLevel());
+    const long batch = 256;
+
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(long b = 0; b < count; b += batch){
+        float x[batch], y[batch], z[batch], ax[batch], ay[batch], az[batch];
+        const long size = b + batch < count ? batch : count - b;
+        for(long k = 0; k < size; ++k){
+            const uint32_t i = active[b + k];
+            x[k] = fragments.px[i]; y[k] = fragments.py[i]; z[k] = fragments.pz[i];
+        }
+        kernel(x, y, z, ax, ay, az, (size_t)size, pull);
+        for(long k = 0; k < size; ++k){
+            const uint32_t i = active[b + k];
+            fragments.ax[i] = ax[k]; fragments.ay[i] = ay[k]; fragments.az[i] = az[k];
+        }
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+#endif
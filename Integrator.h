@@ -0,0 +1,171 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+#include <glm/glm.hpp>
+#include "Body.h"
+#include "FragmentSoA.h"
+using namespace std;
+
+// Time integrators shared by the intact moon and the fragment store.
+//
+//  SemiImplicitEuler  v += a dt; x += v dt. The original scheme, one force
+//                     evaluation, first order.
+//  Leapfrog           kick-drift-kick velocity Verlet, second order and
+//                     symplectic. The closing acceleration is reused as
+//                     the opening one of the next step, so it also costs
+//                     one force evaluation per step.
+//  Yoshida4           fourth-order symplectic composition of three
+//                     leapfrog substeps (Yoshida 1990), three force
+//                     evaluations per step.
+//
+// The symplectic schemes keep the orbital energy bounded instead of
+// drifting, which allows much larger steps for the same accuracy.
+enum class IntegratorType{ SemiImplicitEuler, Leapfrog, Yoshida4 };
+
+inline const char* integratorName(IntegratorType type){
+    switch(type){
+        case IntegratorType::Leapfrog: return "leapfrog";
+        case IntegratorType::Yoshida4: return "yoshida4";
+        default:                       return "euler";
+    }
+}
+
+// Drift (c) and kick (d) coefficients of the Yoshida 4th-order scheme.
+struct Yoshida4Coefficients{
+    double c[4], d[3];
+    Yoshida4Coefficients(){
+        const double cbrt2 = 1.2599210498948732;
+        const double w1 = 1.0/(2.0 - cbrt2);
+        const double w0 = -cbrt2*w1;
+        c[0] = c[3] = 0.5*w1;
+        c[1] = c[2] = 0.5*(w0 + w1);
+        d[0] = d[2] = w1;
+        d[1] = w0;
+    }
+};
+
+inline const Yoshida4Coefficients& yoshida4(){
+    static const Yoshida4Coefficients coefficients;
+    return coefficients;
+}
+
+// ---------------- Single body ----------------
+
+// acceleration(position) returns the acceleration at a position.
+template<typename AccelFn>
+void integrateBody(Body& body, float dTime, IntegratorType type, AccelFn acceleration){
+    switch(type){
+        case IntegratorType::Leapfrog:
+            body.velocity += acceleration(body.position)*(0.5f*dTime);
+            body.position += body.velocity*dTime;
+            body.velocity += acceleration(body.position)*(0.5f*dTime);
+            break;
+        case IntegratorType::Yoshida4: {
+            const Yoshida4Coefficients& y = yoshida4();
+            for(int s = 0; s < 3; ++s){
+                body.position += body.velocity*(float)(y.c[s]*dTime);
+                body.velocity += acceleration(body.position)*(float)(y.d[s]*dTime);
+            }
+            body.position += body.velocity*(float)(y.c[3]*dTime);
+            break;
+        }
+        default:
+            body.velocity += acceleration(body.position)*dTime;
+            body.position += body.velocity*dTime;
+            break;
+    }
+}
+
+// ---------------- Fragment store ----------------
+
+inline void kickFragments(FragmentSoA& fragments, float h, bool parallel){
+    const long n = (long)fragments.size();
+    float* vx = fragments.vx.data();
+    float* vy = fragments.vy.data();
+    float* vz = fragments.vz.data();
+    const float* ax = fragments.ax.data();
+    const float* ay = fragments.ay.data();
+    const float* az = fragments.az.data();
+
+    #pragma omp parallel for simd if(parallel)
+    for(long i = 0; i < n; ++i){
+        vx[i] += ax[i]*h;
+        vy[i] += ay[i]*h;
+        vz[i] += az[i]*h;
+    }
+}
+
+inline void driftFragments(FragmentSoA& fragments, float h, bool parallel){
+    const long n = (long)fragments.size();
+    float* px = fragments.px.data();
+    float* py = fragments.py.data();
+    float* pz = fragments.pz.data();
+    const float* vx = fragments.vx.data();
+    const float* vy = fragments.vy.data();
+    const float* vz = fragments.vz.data();
+
+    #pragma omp parallel for simd if(parallel)
+    for(long i = 0; i < n; ++i){
+        px[i] += vx[i]*h;
+        py[i] += vy[i]*h;
+        pz[i] += vz[i]*h;
+    }
+}
+
+// Fused semi-implicit Euler update, one pass over the arrays.
+inline void kickDriftFragments(FragmentSoA& fragments, float dTime, bool parallel){
+    const long n = (long)fragments.size();
+    float* px = fragments.px.data();
+    float* py = fragments.py.data();
+    float* pz = fragments.pz.data();
+    float* vx = fragments.vx.data();
+    float* vy = fragments.vy.data();
+    float* vz = fragments.vz.data();
+    const float* ax = fragments.ax.data();
+    const float* ay = fragments.ay.data();
+    const float* az = fragments.az.data();
+
+    #pragma omp parallel for simd if(parallel)
+    for(long i = 0; i < n; ++i){
+        vx[i] += ax[i]*dTime;
+        vy[i] += ay[i]*dTime;
+        vz[i] += az[i]*dTime;
+        px[i] += vx[i]*dTime;
+        py[i] += vy[i]*dTime;
+        pz[i] += vz[i]*dTime;
+    }
+}
+
+// computeAcceleration(fragments) must overwrite ax/ay/az with the
+// acceleration at the current positions.
+template<typename AccelFn>
+void integrateFragments(FragmentSoA& fragments, float dTime, IntegratorType type, bool parallel,
+                        AccelFn computeAcceleration){
+    switch(type){
+        case IntegratorType::Leapfrog:
+            if(!fragments.accelerationCurrent) computeAcceleration(fragments);
+            kickFragments(fragments, 0.5f*dTime, parallel);
+            driftFragments(fragments, dTime, parallel);
+            computeAcceleration(fragments);
+            kickFragments(fragments, 0.5f*dTime, parallel);
+            fragments.accelerationCurrent = true;
+            break;
+        case IntegratorType::Yoshida4: {
+            const Yoshida4Coefficients& y = yoshida4();
+            for(int s = 0; s < 3; ++s){
+                driftFragments(fragments, (float)(y.c[s]*dTime), parallel);
+                computeAcceleration(fragments);
+                kickFragments(fragments, (float)(y.d[s]*dTime), parallel);
+            }
+            driftFragments(fragments, (float)(y.c[3]*dTime), parallel);
+            fragments.accelerationCurrent = false;
+            break;
+        }
+        default:
+            computeAcceleration(fragments);
+            kickDriftFragments(fragments, dTime, parallel);
+            fragments.accelerationCurrent = false;
+            break;
+    }
+}
+
+#endif
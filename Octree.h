@@ -0,0 +1,259 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include "FragmentSoA.h"
+using namespace std;
+
+// Morton-ordered octree over the fragment store, shared by the tree-based
+// gravity solvers. Fragments are sorted along a 63-bit Z-order curve, so
+// every node owns a contiguous range of the sorted arrays and the children
+// of a node are stored next to each other in `nodes`.
+
+struct OctreeNode{
+    float cx, cy, cz;       // cube centre
+    float halfSize;         // half the cube edge
+    int begin, end;         // range in the sorted arrays
+    int firstChild;         // index of the first child in nodes
+    int childCount;         // 0 for leaves
+    int level;              // depth, root = 0
+};
+
+// Spreads the low 21 bits of v so there are two zero bits between each.
+inline uint64_t spreadBits3(uint64_t v){
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+// Sorts (key, index) pairs: per-thread chunks are sorted concurrently and
+// then merged pairwise. Ties cannot occur because the index is unique.
+inline void parallelSortKeys(vector<pair<uint64_t, uint32_t>>& keys, bool parallel){
+    const size_t n = keys.size();
+    int chunks = parallel ? omp_get_max_threads() : 1;
+    if(chunks <= 1 || n < (1u << 15)){
+        sort(keys.begin(), keys.end());
+        return;
+    }
+    vector<size_t> bounds(chunks + 1);
+    for(int k = 0; k <= chunks; ++k) bounds[k] = n*(size_t)k/(size_t)chunks;
+
+    #pragma omp parallel for schedule(static)
+    for(int k = 0; k < chunks; ++k)
+        sort(keys.begin() + bounds[k], keys.begin() + bounds[k + 1]);
+
+    for(int width = 1; width < chunks; width *= 2){
+        #pragma omp parallel for schedule(dynamic, 1)
+        for(int k = 0; k < chunks; k += 2*width){
+            if(k + width >= chunks) continue;
+            int last = min(k + 2*width, chunks);
+            inplace_merge(keys.begin() + bounds[k], keys.begin() + bounds[k + width], keys.begin() + bounds[last]);
+        }
+    }
+}
+
+class Octree{
+    public:
+
+    static const int maxLevel = 21;
+
+    int leafSize = 16;                  // a node with this many fragments or fewer is a leaf
+    vector<OctreeNode> nodes;           // nodes[0] is the root
+    vector<vector<int>> levels;         // node indices grouped by depth
+    vector<uint32_t> order;             // sorted slot -> fragment index
+    vector<uint32_t> slot;              // fragment index -> sorted slot
+    aligned_vector<float> x, y, z, m;   // fragment data in sorted order
+
+    size_t size() const { return order.size(); }
+    bool isLeaf(const OctreeNode& node) const { return node.childCount == 0; }
+
+    // Rebuilds the tree for the current fragment positions. The bounding
+    // box, Morton keys, sort and gather run in parallel; the top few
+    // levels are split serially and the subtrees below them are built
+    // concurrently and spliced into `nodes`.
+    void build(const FragmentSoA& fragments, bool parallel = true){
+        const long n = (long)fragments.size();
+        nodes.clear();
+        levels.clear();
+        order.resize(n);
+        slot.resize(n);
+        x.resize(n); y.resize(n); z.resize(n); m.resize(n);
+        if(n == 0) return;
+
+        const float* px = fragments.px.data();
+        const float* py = fragments.py.data();
+        const float* pz = fragments.pz.data();
+
+        float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+        #pragma omp parallel for reduction(min:minX,minY,minZ) reduction(max:maxX,maxY,maxZ) if(parallel)
+        for(long i = 0; i < n; ++i){
+            minX = min(minX, px[i]); maxX = max(maxX, px[i]);
+            minY = min(minY, py[i]); maxY = max(maxY, py[i]);
+            minZ = min(minZ, pz[i]); maxZ = max(maxZ, pz[i]);
+        }
+        float half = 0.5f*max(maxX - minX, max(maxY - minY, maxZ - minZ));
+        half = half*1.001f + 1e-6f;
+        OctreeNode root{0.5f*(minX + maxX), 0.5f*(minY + maxY), 0.5f*(minZ + maxZ), half, 0, (int)n, -1, 0, 0};
+
+        const float cornerX = root.cx - half, cornerY = root.cy - half, cornerZ = root.cz - half;
+        const float scale = (float)(1 << maxLevel)/(2.0f*half);
+        const uint64_t cellMax = (1u << maxLevel) - 1;
+        keys.resize(n);
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long i = 0; i < n; ++i){
+            uint64_t ix = min<uint64_t>((uint64_t)max(0.0f, (px[i] - cornerX)*scale), cellMax);
+            uint64_t iy = min<uint64_t>((uint64_t)max(0.0f, (py[i] - cornerY)*scale), cellMax);
+            uint64_t iz = min<uint64_t>((uint64_t)max(0.0f, (pz[i] - cornerZ)*scale), cellMax);
+            keys[i] = make_pair(spreadBits3(ix) << 2 | spreadBits3(iy) << 1 | spreadBits3(iz), (uint32_t)i);
+        }
+        parallelSortKeys(keys, parallel);
+
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long s = 0; s < n; ++s){
+            uint32_t i = keys[s].second;
+            order[s] = i;
+            slot[i] = (uint32_t)s;
+            x[s] = px[i]; y[s] = py[i]; z[s] = pz[i];
+            m[s] = fragments.mass[i];
+        }
+
+        nodes.push_back(root);
+        vector<int> pending;
+        splitTop(0, parallel ? topLevels : 0, pending);
+
+        vector<vector<OctreeNode>> subtrees(pending.size());
+        #pragma omp parallel for schedule(dynamic, 1) if(parallel)
+        for(long p = 0; p < (long)pending.size(); ++p){
+            subtrees[p].push_back(nodes[pending[p]]);
+            buildSubtree(subtrees[p], 0);
+        }
+
+        vector<size_t> offsets(pending.size() + 1, nodes.size());
+        for(size_t p = 0; p < pending.size(); ++p)
+            offsets[p + 1] = offsets[p] + subtrees[p].size() - 1;
+        nodes.resize(offsets.back());
+
+        #pragma omp parallel for schedule(dynamic, 1) if(parallel)
+        for(long p = 0; p < (long)pending.size(); ++p){
+            const vector<OctreeNode>& local = subtrees[p];
+            const int shift = (int)offsets[p] - 1;
+            OctreeNode& top = nodes[pending[p]];
+            top = local[0];
+            if(top.childCount) top.firstChild += shift;
+            for(size_t k = 1; k < local.size(); ++k){
+                OctreeNode node = local[k];
+                if(node.childCount) node.firstChild += shift;
+                nodes[offsets[p] + k - 1] = node;
+            }
+        }
+
+        for(size_t k = 0; k < nodes.size(); ++k){
+            if((int)levels.size() <= nodes[k].level) levels.resize(nodes[k].level + 1);
+            levels[nodes[k].level].push_back((int)k);
+        }
+    }
+
+    // Re-reads the fragment data in the existing order and fits every cube
+    // to what it holds, bottom up, instead of sorting again. Much cheaper
+    // than build() when fragments have only moved a little, but the cells
+    // overlap more and more as they move, so rebuild now and then.
+    void refit(const FragmentSoA& fragments, bool parallel = true){
+        const long n = (long)size();
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long s = 0; s < n; ++s){
+            uint32_t i = order[s];
+            x[s] = fragments.px[i]; y[s] = fragments.py[i]; z[s] = fragments.pz[i];
+            m[s] = fragments.mass[i];
+        }
+
+        for(int level = (int)levels.size() - 1; level >= 0; --level){
+            const vector<int>& ids = levels[level];
+            #pragma omp parallel for schedule(static) if(parallel)
+            for(long k = 0; k < (long)ids.size(); ++k){
+                OctreeNode& node = nodes[ids[k]];
+                float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+                float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+                if(isLeaf(node)){
+                    for(int s = node.begin; s < node.end; ++s){
+                        minX = min(minX, x[s]); maxX = max(maxX, x[s]);
+                        minY = min(minY, y[s]); maxY = max(maxY, y[s]);
+                        minZ = min(minZ, z[s]); maxZ = max(maxZ, z[s]);
+                    }
+                } else {
+                    for(int c = node.firstChild; c < node.firstChild + node.childCount; ++c){
+                        const OctreeNode& child = nodes[c];
+                        minX = min(minX, child.cx - child.halfSize); maxX = max(maxX, child.cx + child.halfSize);
+                        minY = min(minY, child.cy - child.halfSize); maxY = max(maxY, child.cy + child.halfSize);
+                        minZ = min(minZ, child.cz - child.halfSize); maxZ = max(maxZ, child.cz + child.halfSize);
+                    }
+                }
+                node.cx = 0.5f*(minX + maxX);
+                node.cy = 0.5f*(minY + maxY);
+                node.cz = 0.5f*(minZ + maxZ);
+                node.halfSize = 0.5f*max(maxX - minX, max(maxY - minY, maxZ - minZ));
+            }
+        }
+    }
+
+    private:
+
+    static const int topLevels = 3;     // levels split serially before going parallel
+    vector<pair<uint64_t, uint32_t>> keys;
+
+    // Appends the non-empty children of nodes[index] to `out` contiguously.
+    // Returns false if the node stays a leaf.
+    bool splitNode(vector<OctreeNode>& out, int index) const {
+        OctreeNode node = out[index];
+        if(node.end - node.begin <= leafSize || node.level >= maxLevel) return false;
+
+        const int shift = 3*(maxLevel - 1 - node.level);
+        const float h = 0.5f*node.halfSize;
+        int first = (int)out.size();
+        int begin = node.begin;
+        for(int octant = 0; octant < 8 && begin < node.end; ++octant){
+            auto it = partition_point(keys.begin() + begin, keys.begin() + node.end,
+                [&](const pair<uint64_t, uint32_t>& k){ return (int)((k.first >> shift) & 7) <= octant; });
+            int end = (int)(it - keys.begin());
+            if(end > begin){
+                OctreeNode child{
+                    node.cx + (octant & 4 ? h : -h),
+                    node.cy + (octant & 2 ? h : -h),
+                    node.cz + (octant & 1 ? h : -h),
+                    h, begin, end, -1, 0, node.level + 1};
+                out.push_back(child);
+            }
+            begin = end;
+        }
+        out[index].firstChild = first;
+        out[index].childCount = (int)out.size() - first;
+        return true;
+    }
+
+    void buildSubtree(vector<OctreeNode>& out, int index) const {
+        if(!splitNode(out, index)) return;
+        int first = out[index].firstChild, count = out[index].childCount;
+        for(int c = first; c < first + count; ++c)
+            buildSubtree(out, c);
+    }
+
+    void splitTop(int index, int depth, vector<int>& pending){
+        if(depth == 0 || !splitNode(nodes, index)){
+            pending.push_back(index);
+            return;
+        }
+        int first = nodes[index].firstChild, count = nodes[index].childCount;
+        for(int c = first; c < first + count; ++c)
+            splitTop(c, depth - 1, pending);
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef PARTICLEMESH_H
+#define PARTICLEMESH_H
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <omp.h>
+#include "Gravity.h"
+#include "FFT.h"
+using namespace std;
+
+// Particle-mesh fragment self-gravity with isolated boundaries.
+//
+//  1. Cloud-in-cell deposit of fragment mass onto an n^3 mesh that covers
+//     the fragments' bounding cube.
+//  2. Potential by FFT convolution with the -1/r Green's function on a
+//     zero-padded (2n)^3 grid (Hockney-Eastwood), so there are no
+//     periodic images.
+//  3. Mesh acceleration a = -grad(phi) by central differences, then
+//     cloud-in-cell interpolation back to the fragments.
+//
+// Forces are smoothed below about two mesh cells, which suits smooth
+// clouds and rings; use a tree backend to resolve close encounters.
+class ParticleMeshGravity{
+    public:
+
+    int gridSize = 64;      // mesh nodes per axis, power of two
+
+    // Adds the self-gravity acceleration of every fragment to ax/ay/az.
+    void accumulate(FragmentSoA& fragments, bool parallel = true){
+        const long count = (long)fragments.size();
+        if(count < 2) return;
+        const int n = gridSize, m = 2*gridSize;
+        const long m3 = (long)m*m*m;
+        if(fft.size() != m) prepareGreen(parallel);
+
+        const float* px = fragments.px.data();
+        const float* py = fragments.py.data();
+        const float* pz = fragments.pz.data();
+        float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+        #pragma omp parallel for reduction(min:minX,minY,minZ) reduction(max:maxX,maxY,maxZ) if(parallel)
+        for(long i = 0; i < count; ++i){
+            minX = min(minX, px[i]); maxX = max(maxX, px[i]);
+            minY = min(minY, py[i]); maxY = max(maxY, py[i]);
+            minZ = min(minZ, pz[i]); maxZ = max(maxZ, pz[i]);
+        }
+        // One spare node below and two above, so CIC stencils and the
+        // central differences stay on the mesh.
+        const double extent = max((double)maxX - minX, max((double)maxY - minY, (double)maxZ - minZ));
+        const double h = max(extent, 1e-6)/(n - 3);
+        const double ox = minX - h, oy = minY - h, oz = minZ - h;
+
+        // 1. Deposit.
+        density.assign(m3, complex<double>(0.0));
+        double* rho = reinterpret_cast<double*>(density.data());
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long p = 0; p < count; ++p){
+            Stencil s = stencil(px[p], py[p], pz[p], ox, oy, oz, h);
+            for(int c = 0; c < 8; ++c){
+                long node = s.node(c, m);
+                double w = fragments.mass[p]*s.weight(c);
+                #pragma omp atomic
+                rho[2*node] += w;
+            }
+        }
+
+        // 2. phi = G * (rho conv g); g scales as 1/h, see prepareGreen.
+        fft.transform3D(density, false, parallel);
+        const double scale = G/h;
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long i = 0; i < m3; ++i) density[i] *= green[i]*scale;
+        fft.transform3D(density, true, parallel);
+
+        // 3. Central differences on the n^3 region, gathered with CIC.
+        meshAx.resize((long)n*n*n); meshAy.resize((long)n*n*n); meshAz.resize((long)n*n*n);
+        const double inv2h = 0.5/h;
+        #pragma omp parallel for collapse(2) schedule(static) if(parallel)
+        for(int k = 0; k < n; ++k){
+            for(int j = 0; j < n; ++j){
+                for(int i = 0; i < n; ++i){
+                    long node = i + (long)n*(j + (long)n*k);
+                    meshAx[node] = -(phi(i + 1, j, k, m) - phi(i - 1, j, k, m))*inv2h;
+                    meshAy[node] = -(phi(i, j + 1, k, m) - phi(i, j - 1, k, m))*inv2h;
+                    meshAz[node] = -(phi(i, j, k + 1, m) - phi(i, j, k - 1, m))*inv2h;
+                }
+            }
+        }
+
+        #pragma omp parallel for schedule(static) if(parallel)
+        for(long p = 0; p < count; ++p){
+            Stencil s = stencil(px[p], py[p], pz[p], ox, oy, oz, h);
+            double ax = 0.0, ay = 0.0, az = 0.0;
+            for(int c = 0; c < 8; ++c){
+                long node = s.node(c, n);
+                double w = s.weight(c);
+                ax += w*meshAx[node]; ay += w*meshAy[node]; az += w*meshAz[node];
+            }
+            fragments.ax[p] += (float)ax;
+            fragments.ay[p] += (float)ay;
+            fragments.az[p] += (float)az;
+        }
+    }
+
+    private:
+
+    FFT3D fft;
+    vector<complex<double>> density;    // mass, then potential, on the padded grid
+    vector<complex<double>> green;      // transformed Green's function for h = 1
+    vector<double> meshAx, meshAy, meshAz;
+
+    struct Stencil{
+        int i, j, k;
+        double fx, fy, fz;
+        long node(int c, int dim) const {
+            return (i + (c & 1)) + (long)dim*((j + (c >> 1 & 1)) + (long)dim*(k + (c >> 2 & 1)));
+        }
+        double weight(int c) const {
+            return (c & 1 ? fx : 1.0 - fx)*(c & 2 ? fy : 1.0 - fy)*(c & 4 ? fz : 1.0 - fz);
+        }
+    };
+
+    static Stencil stencil(float x, float y, float z, double ox, double oy, double oz, double h){
+        double u = (x - ox)/h, v = (y - oy)/h, w = (z - oz)/h;
+        Stencil s;
+        s.i = (int)u; s.j = (int)v; s.k = (int)w;
+        s.fx = u - s.i; s.fy = v - s.j; s.fz = w - s.k;
+        return s;
+    }
+
+    // Potential on the padded grid; -1 wraps to the last padded node,
+    // which holds the correct isolated potential one cell below the mesh.
+    double phi(int i, int j, int k, int m) const {
+        i = (i + m) % m; j = (j + m) % m; k = (k + m) % m;
+        return density[i + (long)m*(j + (long)m*k)].real();
+    }
+
+    // -1/r on the padded grid for unit cell size, with distances wrapped
+    // so every source-target offset inside the n^3 mesh appears once. The
+    // self term is softened to half a cell. Dividing by h later gives the
+    // kernel for any cell size, so this only depends on gridSize.
+    void prepareGreen(bool parallel){
+        const int m = 2*gridSize;
+        const long m3 = (long)m*m*m;
+        fft.resize(m);
+        green.assign(m3, complex<double>(0.0));
+        #pragma omp parallel for collapse(2) schedule(static) if(parallel)
+        for(int k = 0; k < m; ++k){
+            for(int j = 0; j < m; ++j){
+                for(int i = 0; i < m; ++i){
+                    double dx = min(i, m - i), dy = min(j, m - j), dz = min(k, m - k);
+                    double r2 = dx*dx + dy*dy + dz*dz;
+                    green[i + (long)m*(j + (long)m*k)] = -1.0/sqrt(max(r2, 0.25));
+                }
+            }
+        }
+        fft.transform3D(green, false, parallel);
+    }
+};
+
+#endif
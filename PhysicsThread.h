@@ -0,0 +1,152 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <omp.h>
+#include "Simulation.h"
+using namespace std;
+
+// Lock-free triple buffer for one producer and one consumer. The producer
+// fills writeBuffer() and publishes it; the consumer calls acquire() to
+// pick up the newest published buffer and reads readBuffer(). Neither side
+// ever waits, and a buffer is never written while it is being read.
+template<typename T>
+class TripleBuffer{
+    public:
+
+    T& writeBuffer(){ return buffers[back]; }
+
+    void publish(){
+        back = middle.exchange(back | fresh, memory_order_acq_rel) & indexMask;
+    }
+
+    // Returns false when nothing new was published since the last call.
+    bool acquire(){
+        if(!(middle.load(memory_order_acquire) & fresh)) return false;
+        front = middle.exchange(front, memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const T& readBuffer() const { return buffers[front]; }
+
+    private:
+
+    static constexpr int fresh = 4, indexMask = 3;
+    T buffers[3];
+    int back = 0, front = 1;
+    atomic<int> middle{2};
+};
+
+// What the render thread needs from one physics state: the last two
+// positions of everything, so drawing can interpolate between them while
+// the next snapshot is being computed. Fragment positions stay in the
+// simulation's SoA layout, one slice per axis.
+struct SimulationSnapshot{
+    double time = 0.0;
+    long step = 0;
+    double stepSeconds = 0.0;
+    chrono::steady_clock::time_point publishedAt;
+    bool fragmentsInitialized = false;
+    glm::vec3 moonPosition = glm::vec3(0.0f), previousMoonPosition = glm::vec3(0.0f);
+    aligned_vector<float> fragmentX, fragmentY, fragmentZ;
+    aligned_vector<float> previousFragmentX, previousFragmentY, previousFragmentZ;
+
+    // 0 at publication, reaching 1 one physics step later.
+    float alpha() const {
+        if(stepSeconds <= 0.0) return 1.0f;
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - publishedAt).count();
+        return (float)min(elapsed/stepSeconds, 1.0);
+    }
+    glm::vec3 moon(float alpha) const {
+        return previousMoonPosition + (moonPosition - previousMoonPosition)*alpha;
+    }
+    size_t fragmentCount() const { return fragmentX.size(); }
+    glm::vec3 fragment(size_t i, float alpha) const {
+        return glm::vec3(previousFragmentX[i] + (fragmentX[i] - previousFragmentX[i])*alpha,
+                         previousFragmentY[i] + (fragmentY[i] - previousFragmentY[i])*alpha,
+                         previousFragmentZ[i] + (fragmentZ[i] - previousFragmentZ[i])*alpha);
+    }
+};
+
+// Runs a Simulation on its own thread against wall-clock time and
+// publishes a snapshot after every batch of fixed steps. The OpenMP
+// kernels get their own thread team rooted on this thread, so a slow
+// frame or a blocking buffer swap on the GL thread no longer holds up the
+// physics. The Simulation must not be touched elsewhere while running.
+class PhysicsThread{
+    public:
+
+    explicit PhysicsThread(Simulation& simulation) : simulation(simulation){}
+    ~PhysicsThread(){ stop(); }
+
+    PhysicsThread(const PhysicsThread&) = delete;
+    PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+    void start(){
+        if(running.exchange(true)) return;
+        publish();
+        snapshots.acquire();
+        worker = thread(&PhysicsThread::run, this);
+    }
+
+    void stop(){
+        running = false;
+        if(worker.joinable()) worker.join();
+    }
+
+    // Latest completed snapshot; never blocks.
+    const SimulationSnapshot& latest(){
+        snapshots.acquire();
+        return snapshots.readBuffer();
+    }
+
+    private:
+
+    Simulation& simulation;
+    TripleBuffer<SimulationSnapshot> snapshots;
+    atomic<bool> running{false};
+    thread worker;
+
+    void run(){
+        // The OpenMP thread count is per thread, so the one set on the main
+        // thread does not carry over to this one.
+        if(simulation.threads > 0) omp_set_num_threads(simulation.threads);
+        using clock = chrono::steady_clock;
+        clock::time_point last = clock::now();
+        while(running){
+            clock::time_point now = clock::now();
+            double frameTime = chrono::duration<double>(now - last).count();
+            last = now;
+            if(simulation.advance(frameTime) > 0){
+                publish();
+            } else {
+                // Sleep until the next fixed step is due.
+                double wait = simulation.clock.step - simulation.clock.accumulator;
+                this_thread::sleep_for(chrono::duration<double>(wait));
+            }
+        }
+    }
+
+    void publish(){
+        SimulationSnapshot& s = snapshots.writeBuffer();
+        s.time = simulation.time;
+        s.step = simulation.stepCount;
+        s.fragmentsInitialized = simulation.fragmentsInitialized;
+        s.stepSeconds = simulation.clock.step;
+        s.publishedAt = chrono::steady_clock::now();
+        s.moonPosition = simulation.moon.position;
+        s.previousMoonPosition = simulation.moonPosition(0.0f);
+        const FragmentSoA& fragments = simulation.fragments;
+        s.fragmentX.assign(fragments.px.begin(), fragments.px.end());
+        s.fragmentY.assign(fragments.py.begin(), fragments.py.end());
+        s.fragmentZ.assign(fragments.pz.begin(), fragments.pz.end());
+        simulation.copyPreviousFragmentPositions(s.previousFragmentX, s.previousFragmentY, s.previousFragmentZ);
+        snapshots.publish();
+    }
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SELFGRAVITY_H
+#define SELFGRAVITY_H
+#include "Gravity.h"
+#include "BarnesHut.h"
+#include "FMM.h"
+#include "DirectGravity.h"
+#include "ParticleMesh.h"
+#include "BlockTimestep.h"
+using namespace std;
+
+// Fragment-fragment gravity, added on top of the planet pull. The backend
+// is chosen at runtime; PlanetOnly keeps the original planet-only model.
+enum class GravityBackend{ PlanetOnly, BarnesHut, FMM, Direct, ParticleMesh };
+
+class SelfGravity{
+    public:
+
+    GravityBackend backend = GravityBackend::PlanetOnly;
+    BarnesHutGravity barnesHut;
+    FMMGravity fmm;
+    DirectGravity direct;
+    ParticleMeshGravity particleMesh;
+
+    // Plummer softening length of the pairwise backends. The particle mesh
+    // is smoothed by its grid instead.
+    void setSoftening(float length){
+        barnesHut.softening = length;
+        fmm.softening = length;
+        direct.softening = length;
+    }
+
+    // Adds the mutual acceleration of the fragments to ax/ay/az.
+    void accumulate(FragmentSoA& fragments, bool parallel = true){
+        switch(backend){
+            case GravityBackend::BarnesHut: barnesHut.accumulate(fragments, parallel); break;
+            case GravityBackend::FMM:       fmm.accumulate(fragments, parallel); break;
+            case GravityBackend::Direct:    direct.accumulate(fragments, parallel); break;
+            case GravityBackend::ParticleMesh: particleMesh.accumulate(fragments, parallel); break;
+            default: break;
+        }
+    }
+
+    // Adds the mutual acceleration to at least the listed fragments and
+    // returns how many fragments were evaluated. The tree and direct
+    // backends only evaluate those targets; FMM and the particle mesh solve
+    // for every fragment anyway, so they fall back to accumulate. refit lets
+    // Barnes-Hut reuse the previous call's tree, see accumulateActive there.
+    long accumulateActive(FragmentSoA& fragments, const vector<uint32_t>& active, bool refit, bool parallel = true){
+        switch(backend){
+            case GravityBackend::BarnesHut: barnesHut.accumulateActive(fragments, active, refit, parallel); break;
+            case GravityBackend::Direct:    direct.accumulateActive(fragments, active, parallel); break;
+            case GravityBackend::PlanetOnly: break;
+            default:
+                accumulate(fragments, parallel);
+                return (long)fragments.size();
+        }
+        return (long)active.size();
+    }
+};
+
+void parallelUpdateGravity(Body& planet, FragmentSoA& fragments, float dTime, SelfGravity& selfGravity,
+                           IntegratorType integrator = IntegratorType::SemiImplicitEuler){
+    const glm::vec3 center = planet.position;
+    const float GM = G*planet.mass;
+    integrateFragments(fragments, dTime, integrator, true, [&](FragmentSoA& f){
+        computeCentralAcceleration(f, center, GM, true);
+        selfGravity.accumulate(f, true);
+    });
+}
+void serialUpdateGravity(Body& planet, FragmentSoA& fragments, float dTime, SelfGravity& selfGravity,
+                         IntegratorType integrator = IntegratorType::SemiImplicitEuler){
+    const glm::vec3 center = planet.position;
+    const float GM = G*planet.mass;
+    integrateFragments(fragments, dTime, integrator, false, [&](FragmentSoA& f){
+        computeCentralAcceleration(f, center, GM, false);
+        selfGravity.accumulate(f, false);
+    });
+}
+
+// Block-timestep variants: only fragments at the end of their step get a
+// self-gravity evaluation, see BlockTimestep.h.
+void parallelUpdateGravity(Body& planet, FragmentSoA& fragments, float dTime, SelfGravity& selfGravity,
+                           BlockTimestepper& timestepper){
+    const glm::vec3 center = planet.position;
+    const float GM = G*planet.mass;
+    timestepper.step(fragments, dTime, true, [&](FragmentSoA& f, const vector<uint32_t>& active, bool refit){
+        computeCentralAcceleration(f, active, center, GM, true);
+        return selfGravity.accumulateActive(f, active, refit, true);
+    });
+}
+void serialUpdateGravity(Body& planet, FragmentSoA& fragments, float dTime, SelfGravity& selfGravity,
+                         BlockTimestepper& timestepper){
+    const glm::vec3 center = planet.position;
+    const float GM = G*planet.mass;
+    timestepper.step(fragments, dTime, false, [&](FragmentSoA& f, const vector<uint32_t>& active, bool refit){
+        computeCentralAcceleration(f, active, center, GM, false);
+        return selfGravity.accumulateActive(f, active, refit, false);
+    });
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+inline GLuint compileShader(GLenum type, const char* src) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[1024];
+        glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << "Shader compilation error (type " << type << "):\n" << infoLog << std::endl;
+    }
+    return shader;
+}
+
+inline bool checkProgramLinkStatus(GLuint prog) {
+    GLint success;
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[1024];
+        glGetProgramInfoLog(prog, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << "Program link error:\n" << infoLog << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A linked vertex + fragment program. Every active uniform location is
+// looked up once after linking, so the render loop never asks the driver
+// for a location by name.
+class ShaderProgram {
+public:
+    ShaderProgram(const char* vertexSource, const char* fragmentSource) {
+        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+        GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        linked = checkProgramLinkStatus(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        if (linked) cacheUniforms();
+    }
+
+    ~ShaderProgram() { glDeleteProgram(program); }
+
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    bool valid() const { return linked; }
+    GLuint id() const { return program; }
+    void use() const { glUseProgram(program); }
+
+    // Cached location, or -1 (ignored by glUniform*) if the uniform is not
+    // active. Keep the result in a local for per-object uniforms.
+    GLint uniform(const std::string& name) const {
+        auto it = locations.find(name);
+        return it == locations.end() ? -1 : it->second;
+    }
+
+    // Points a uniform block of this program at a buffer binding point.
+    void bindUniformBlock(const char* blockName, GLuint bindingPoint) const {
+        GLuint index = glGetUniformBlockIndex(program, blockName);
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, bindingPoint);
+    }
+
+private:
+    GLuint program{};
+    bool linked{};
+    std::unordered_map<std::string, GLint> locations;
+
+    void cacheUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string key(name.data(), length);
+            GLint location = glGetUniformLocation(program, key.c_str());
+            if (location < 0) continue;     // member of a uniform block
+            if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) key.resize(key.size() - 3);
+            locations[key] = location;
+        }
+    }
+};
+
+// View and projection shared by every program through one uniform buffer,
+// declared in GLSL as
+//   layout (std140) uniform Camera { mat4 view; mat4 projection; };
+// and updated once per frame.
+class CameraUniforms {
+public:
+    static const GLuint binding = 0;
+
+    CameraUniforms() {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+    }
+
+    ~CameraUniforms() { glDeleteBuffers(1, &ubo); }
+
+    CameraUniforms(const CameraUniforms&) = delete;
+    CameraUniforms& operator=(const CameraUniforms&) = delete;
+
+    void attach(const ShaderProgram& program) const { program.bindUniformBlock("Camera", binding); }
+
+    void update(const glm::mat4& view, const glm::mat4& projection) {
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(view));
+        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projection));
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    GLuint ubo{};
+};
+
+#endif
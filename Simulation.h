@@ -0,0 +1,159 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Gravity.h"
+#include "SelfGravity.h"
+#include "roche.h"
+using namespace std;
+
+// Fixed-step physics clock. Frame time is poured into an accumulator and
+// drained in whole steps of `step` seconds, so the physics is the same at
+// any frame rate. alpha() is how far the render time sits between the
+// last two physics states.
+class FixedStepClock{
+    public:
+
+    double step = 1.0/120.0;
+    int maxSubsteps = 8;        // backlog beyond this is dropped, so a slow frame cannot snowball
+    double accumulator = 0.0;
+
+    // Adds one frame's wall-clock time and returns the number of steps to run.
+    int advance(double frameTime){
+        accumulator += max(frameTime, 0.0);
+        int steps = (int)(accumulator/step);
+        if(steps > maxSubsteps){
+            steps = maxSubsteps;
+            accumulator = 0.0;
+        } else {
+            accumulator -= steps*step;
+        }
+        return steps;
+    }
+
+    float alpha() const { return (float)min(accumulator/step, 1.0); }
+};
+
+// Appends the moon's fragments (centre, velocity, radius, fragment radius)
+// to a FragmentSoA, e.g. the MoonMaker generators.
+using FragmentMaker = void (*)(glm::vec3, glm::vec3, double, double, FragmentSoA&);
+
+// Planet, moon and fragment state plus the per-step physics the render
+// loops used to do inline: Roche check, breakup, gravity update.
+class Simulation{
+    public:
+
+    Body planet, moon;
+    float planetRadius, moonRadius;
+    float fragmentRadius = 0.05f;
+
+    FragmentSoA fragments;
+    SelfGravity selfGravity;    // GravityBackend::PlanetOnly unless switched
+    IntegratorType integrator = IntegratorType::Leapfrog;
+    BlockTimestepper timestepper;   // per-fragment power-of-two steps within each physics step
+    bool blockTimesteps = false;    // fragments on timestepper levels instead of `integrator`
+    FixedStepClock clock;
+
+    bool parallel;
+    int threads = 0;            // OpenMP team size for whoever runs the steps, 0 = default
+    FragmentMaker makeFragments;
+    bool passedRocheLimit = false;
+    bool fragmentsInitialized = false;
+    double time = 0.0;
+    long stepCount = 0;
+    double breakupTime = -1.0;  // simulation time of the breakup, -1 while intact
+
+    Simulation(const Body& planet, const Body& moon, float planetRadius, float moonRadius,
+               FragmentMaker makeFragments, bool parallel = true)
+        : planet(planet), moon(moon), planetRadius(planetRadius), moonRadius(moonRadius),
+          parallel(parallel), makeFragments(makeFragments), previousMoon(moon.position){}
+
+    // One fixed physics step.
+    void step(float dTime){
+        if(!passedRocheLimit)
+            passedRocheLimit = update_roche_status(planet, moon, planetRadius, moonRadius);
+
+        if(passedRocheLimit && !fragmentsInitialized){
+            makeFragments(moon.position, moon.velocity, moonRadius, fragmentRadius, fragments);
+            if(selfGravity.backend != GravityBackend::PlanetOnly){
+                // Fragments are spheres of fragmentRadius, so they should
+                // not pull on each other as points closer than that.
+                scaleFragmentMass(moon.mass);
+                selfGravity.setSoftening(fragmentRadius);
+            }
+            fragmentsInitialized = true;
+            breakupTime = time;
+        }
+
+        if(fragmentsInitialized && blockTimesteps){
+            if(parallel) parallelUpdateGravity(planet, fragments, dTime, selfGravity, timestepper);
+            else serialUpdateGravity(planet, fragments, dTime, selfGravity, timestepper);
+        } else if(fragmentsInitialized){
+            if(parallel) parallelUpdateGravity(planet, fragments, dTime, selfGravity, integrator);
+            else serialUpdateGravity(planet, fragments, dTime, selfGravity, integrator);
+        } else {
+            updateGravity(planet, moon, dTime, integrator);
+        }
+        time += dTime;
+        ++stepCount;
+    }
+
+    // The generators take fragment masses from density_function, which is
+    // in its own units and sums to far more than the moon. Planet-only
+    // gravity never reads them, but self-gravity does, so with a backend on
+    // they are scaled to total the moon's mass, keeping the profile's shape.
+    void scaleFragmentMass(float totalMass){
+        double sum = 0.0;
+        for(size_t i = 0; i < fragments.size(); ++i) sum += fragments.mass[i];
+        if(sum <= 0.0) return;
+        const float scale = (float)(totalMass/sum);
+        for(size_t i = 0; i < fragments.size(); ++i) fragments.mass[i] *= scale;
+    }
+
+    // Runs as many fixed steps as frameTime covers and returns the count.
+    // The state before the last step is kept for interpolation.
+    int advance(double frameTime){
+        const int steps = clock.advance(frameTime);
+        for(int s = 0; s < steps; ++s){
+            if(s == steps - 1) savePrevious();
+            step((float)clock.step);
+        }
+        return steps;
+    }
+
+    // Render positions, interpolated between the last two physics states.
+    glm::vec3 moonPosition(float alpha) const {
+        return previousMoon + (moon.position - previousMoon)*alpha;
+    }
+    glm::vec3 fragmentPosition(size_t i, float alpha) const {
+        glm::vec3 current = fragments.position(i);
+        if(i >= previousX.size()) return current;
+        glm::vec3 previous(previousX[i], previousY[i], previousZ[i]);
+        return previous + (current - previous)*alpha;
+    }
+
+    // Copies the fragment positions before the last step into x/y/z, or
+    // the current ones if no earlier state was kept yet.
+    void copyPreviousFragmentPositions(aligned_vector<float>& x, aligned_vector<float>& y, aligned_vector<float>& z) const {
+        const bool kept = previousX.size() == fragments.size();
+        x.assign((kept ? previousX : fragments.px).begin(), (kept ? previousX : fragments.px).end());
+        y.assign((kept ? previousY : fragments.py).begin(), (kept ? previousY : fragments.py).end());
+        z.assign((kept ? previousZ : fragments.pz).begin(), (kept ? previousZ : fragments.pz).end());
+    }
+
+    private:
+
+    glm::vec3 previousMoon;
+    aligned_vector<float> previousX, previousY, previousZ;
+
+    void savePrevious(){
+        previousMoon = moon.position;
+        previousX.assign(fragments.px.begin(), fragments.px.end());
+        previousY.assign(fragments.py.begin(), fragments.py.end());
+        previousZ.assign(fragments.pz.begin(), fragments.pz.end());
+    }
+};
+
+#endif
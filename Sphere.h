@@ -2,12 +2,38 @@
 #define SPHERE_H
 
 #include <glad/glad.h>
+#include "StreamBuffer.h"
 #include <vector>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+
+// Per-instance attributes for Sphere::drawInstanced: a translation, a
+// uniform scale and a colour. Bound to attribute locations 1 (xyz + scale)
+// and 2 (rgb).
+struct SphereInstance {
+    float x, y, z;
+    float scale;
+    float r, g, b;
+};
+
+// Points instance attributes 1 and 2 of the bound VAO at `buffer`, starting
+// at a byte offset; divisor 1 for instanced meshes, 0 when each instance
+// is a point.
+inline void bindSphereInstanceAttributes(GLuint buffer, size_t offset, GLuint divisor) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)(offset + offsetof(SphereInstance, x)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, divisor);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (void*)(offset + offsetof(SphereInstance, r)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, divisor);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
 class Sphere {
 public:
-    Sphere(float radius = 1.0f, unsigned int sectorCount = 36, unsigned int stackCount = 18) {
+    Sphere(float radius = 1.0f, unsigned int sectorCount = 36, unsigned int stackCount = 18) : sphereRadius(radius) {
         buildSphere(radius, sectorCount, stackCount);
     }
 
@@ -15,20 +41,65 @@ public:
         glDeleteVertexArrays(1, &VAO);
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
+        if (pointVAO) glDeleteVertexArrays(1, &pointVAO);
     }
 
+    float radius() const { return sphereRadius; }
+
     void draw() {
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
     }
 
-private:
-    GLuint VAO{}, VBO{}, EBO{};
-    unsigned int indexCount{};
+    // Returns room for `count` instances in GPU-visible memory; write them
+    // and call drawInstanced(). No intermediate copy is made.
+    SphereInstance* mapInstances(size_t count) {
+        instanceCount = count;
+        return (SphereInstance*)instances.map(count * sizeof(SphereInstance));
+    }
 
-    void buildSphere(float radius, unsigned int sectorCount, unsigned int stackCount) {
-        std::vector<float> vertices;
-        std::vector<unsigned int> indices;
+    void updateInstances(const SphereInstance* data, size_t count) {
+        memcpy(mapInstances(count), data, count * sizeof(SphereInstance));
+    }
+
+    // Draws every mapped instance with a single call.
+    void drawInstanced() {
+        if (!instances.id()) return;
+        const size_t offset = instances.unmap();
+        drawInstancedFrom(instances.id(), offset, instanceCount);
+        instances.fence();
+    }
+
+    // Draws `count` instances read from another buffer at a byte offset,
+    // e.g. one bucket of a SphereLOD batch. Fencing is up to the caller.
+    void drawInstancedFrom(GLuint buffer, size_t offset, size_t count) {
+        if (count == 0) return;
+        glBindVertexArray(VAO);
+        bindSphereInstanceAttributes(buffer, offset, 1);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, (GLsizei)count);
+        glBindVertexArray(0);
+    }
+
+    // Draws every mapped instance as one GL_POINTS vertex, for an impostor
+    // shader that ray-casts the sphere per pixel: one vertex per instance
+    // instead of the whole mesh.
+    void drawImpostors() {
+        if (!instances.id()) return;
+        const size_t offset = instances.unmap();
+        if (instanceCount > 0) {
+            if (!pointVAO) glGenVertexArrays(1, &pointVAO);
+            glBindVertexArray(pointVAO);
+            bindSphereInstanceAttributes(instances.id(), offset, 0);
+            glDrawArrays(GL_POINTS, 0, (GLsizei)instanceCount);
+            glBindVertexArray(0);
+        }
+        instances.fence();
+    }
+
+    // UV-sphere geometry: xyz positions and triangle indices, appended to
+    // the vectors. Indices start at 0 for this mesh.
+    static void tessellate(float radius, unsigned int sectorCount, unsigned int stackCount,
+                           std::vector<float>& vertices, std::vector<unsigned int>& indices) {
         const float PI = 3.14159265359f;
 
         for (unsigned int i = 0; i <= stackCount; ++i) {
@@ -62,6 +133,20 @@ private:
                 }
             }
         }
+    }
+
+private:
+    GLuint VAO{}, VBO{}, EBO{};
+    unsigned int indexCount{};
+    float sphereRadius;
+    GLuint pointVAO{};
+    StreamBuffer instances;
+    size_t instanceCount{};
+
+    void buildSphere(float radius, unsigned int sectorCount, unsigned int stackCount) {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        tessellate(radius, sectorCount, stackCount, vertices, indices);
 
         indexCount = indices.size();
 
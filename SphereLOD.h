@@ -0,0 +1,154 @@
+#ifndef SPHERELOD_H
+#define SPHERELOD_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "GLExtensions.h"
+#include "Sphere.h"
+#include "StreamBuffer.h"
+
+// A sphere tessellated at several levels of detail, built once into one
+// shared vertex/index buffer. Instances are sorted into one bucket per
+// level by their projected radius in pixels (culled instances get no
+// bucket); each frame the buckets are written back to back into one
+// streaming buffer.
+//
+// With glMultiDrawElementsIndirect every bucket becomes one command of a
+// single indirect draw, baseInstance selecting its instances. On plain 3.3
+// each bucket is one glDrawElementsInstancedBaseVertex with the instance
+// attributes re-pointed at the bucket.
+class SphereLOD {
+public:
+    // Tessellations (sectors, stacks) from finest to coarsest, and the
+    // smallest on-screen radius in pixels each of them is used for; the
+    // last level takes everything below the previous threshold.
+    SphereLOD(float radius,
+              std::vector<std::pair<unsigned int, unsigned int>> tessellations = {{16, 12}, {10, 6}, {6, 4}, {4, 3}},
+              std::vector<float> minPixelRadius = {24.0f, 8.0f, 3.0f})
+        : sphereRadius(radius), thresholds(minPixelRadius) {
+        buildMeshes(tessellations);
+        thresholds.resize(meshes.size() - 1, 0.0f);
+        bucketStart.assign(meshes.size() + 1, 0);
+    }
+
+    ~SphereLOD() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        if (indirectBuffer) glDeleteBuffers(1, &indirectBuffer);
+    }
+
+    SphereLOD(const SphereLOD&) = delete;
+    SphereLOD& operator=(const SphereLOD&) = delete;
+
+    float radius() const { return sphereRadius; }
+    int levelCount() const { return (int)meshes.size(); }
+    bool indirect() const { return glExtensions().multiDrawElementsIndirect != nullptr; }
+
+    int levelFor(float pixelRadius) const {
+        int level = 0;
+        while (level < (int)thresholds.size() && pixelRadius < thresholds[level]) ++level;
+        return level;
+    }
+
+    // Maps room for levelCounts[k] instances on every level k. Instances of
+    // level k go to mapped[bucketOffset(k) .. bucketOffset(k) + levelCounts[k]).
+    SphereInstance* mapInstances(const size_t* levelCounts) {
+        bucketStart[0] = 0;
+        for (size_t k = 0; k < meshes.size(); ++k) bucketStart[k + 1] = bucketStart[k] + levelCounts[k];
+        return (SphereInstance*)instances.map(bucketStart.back() * sizeof(SphereInstance));
+    }
+
+    size_t bucketOffset(int level) const { return bucketStart[level]; }
+
+    void drawInstanced() {
+        if (!instances.id()) return;
+        const size_t offset = instances.unmap();
+        glBindVertexArray(VAO);
+        if (PFNEXTMULTIDRAWELEMENTSINDIRECTPROC multiDraw = glExtensions().multiDrawElementsIndirect) {
+            commands.clear();
+            for (size_t k = 0; k < meshes.size(); ++k) {
+                GLuint count = (GLuint)(bucketStart[k + 1] - bucketStart[k]);
+                if (count == 0) continue;
+                commands.push_back({meshes[k].indexCount, count, meshes[k].firstIndex,
+                                    meshes[k].baseVertex, (GLuint)bucketStart[k]});
+            }
+            if (!commands.empty()) {
+                if (!indirectBuffer) glGenBuffers(1, &indirectBuffer);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+                glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STREAM_DRAW);
+                bindSphereInstanceAttributes(instances.id(), offset, 1);
+                multiDraw(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)commands.size(), 0);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            }
+        } else {
+            for (size_t k = 0; k < meshes.size(); ++k) {
+                size_t count = bucketStart[k + 1] - bucketStart[k];
+                if (count == 0) continue;
+                bindSphereInstanceAttributes(instances.id(), offset + bucketStart[k] * sizeof(SphereInstance), 1);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, meshes[k].indexCount, GL_UNSIGNED_INT,
+                                                  (void*)(meshes[k].firstIndex * sizeof(unsigned int)),
+                                                  (GLsizei)count, meshes[k].baseVertex);
+            }
+        }
+        glBindVertexArray(0);
+        instances.fence();
+    }
+
+private:
+    // Layout fixed by the GL spec for indirect indexed draws.
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Mesh {
+        GLuint indexCount, firstIndex;
+        GLint baseVertex;
+    };
+
+    float sphereRadius;
+    std::vector<float> thresholds;
+    std::vector<Mesh> meshes;
+    std::vector<size_t> bucketStart;
+    std::vector<DrawCommand> commands;
+    GLuint VAO{}, VBO{}, EBO{}, indirectBuffer{};
+    StreamBuffer instances;
+
+    void buildMeshes(const std::vector<std::pair<unsigned int, unsigned int>>& tessellations) {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        for (auto& t : tessellations) {
+            Mesh mesh;
+            mesh.firstIndex = (GLuint)indices.size();
+            mesh.baseVertex = (GLint)(vertices.size() / 3);
+            Sphere::tessellate(sphereRadius, t.first, t.second, vertices, indices);
+            mesh.indexCount = (GLuint)indices.size() - mesh.firstIndex;
+            meshes.push_back(mesh);
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindVertexArray(0);
+    }
+};
+
+#endif
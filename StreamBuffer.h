@@ -0,0 +1,101 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include "GLExtensions.h"
+
+// Ring of three equal segments in one GL_ARRAY_BUFFER for data rewritten
+// every frame. The CPU writes segment k while the GPU may still be reading
+// k-1 and k-2; a fence per segment makes sure a segment is only reused
+// once the draws that read it have finished.
+//
+// With buffer storage the whole buffer is mapped once, persistently and
+// coherently, so map() is pointer arithmetic. Otherwise each segment is
+// mapped unsynchronized for the write, which the fences make safe.
+class StreamBuffer {
+public:
+    static const int segments = 3;
+
+    StreamBuffer() = default;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+    ~StreamBuffer() { release(); }
+
+    GLuint id() const { return buffer; }
+    bool persistent() const { return persistentPointer != nullptr; }
+
+    // Returns `bytes` of writable memory in the next segment.
+    void* map(size_t bytes) {
+        if (!buffer || bytes > segmentSize) allocate(bytes + bytes / 2);
+        current = (current + 1) % segments;
+        waitFor(current);
+        if (persistentPointer) return persistentPointer + current * segmentSize;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        return glMapBufferRange(GL_ARRAY_BUFFER, current * segmentSize, segmentSize,
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    // Ends the write and returns the byte offset of the segment, for the
+    // attribute pointers of the draw that reads it.
+    size_t unmap() {
+        if (!persistentPointer) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        return current * segmentSize;
+    }
+
+    // Call after the draw calls that read the current segment.
+    void fence() {
+        if (fences[current]) glDeleteSync(fences[current]);
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    GLuint buffer{};
+    size_t segmentSize{};
+    int current{};
+    GLsync fences[segments]{};
+    char* persistentPointer{};
+
+    void waitFor(int segment) {
+        GLsync sync = fences[segment];
+        if (!sync) return;
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(sync, flags, 1000000) == GL_TIMEOUT_EXPIRED) flags = 0;
+        glDeleteSync(sync);
+        fences[segment] = nullptr;
+    }
+
+    void allocate(size_t bytes) {
+        release();
+        segmentSize = (bytes + 256) & ~(size_t)255;
+        const size_t total = segments * segmentSize;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (PFNEXTBUFFERSTORAGEPROC storage = glExtensions().bufferStorage) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            storage(GL_ARRAY_BUFFER, total, nullptr, flags);
+            persistentPointer = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Deleting the buffer is safe while draws are in flight; GL keeps the
+    // storage alive until they complete.
+    void release() {
+        for (GLsync& sync : fences) {
+            if (sync) glDeleteSync(sync);
+            sync = nullptr;
+        }
+        if (buffer) glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        segmentSize = 0;
+        persistentPointer = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+// fmm_bench.cpp
+// Accuracy-vs-order benchmark for the FMM self-gravity backend.
+// Builds a spherical debris cloud, computes the exact softened sum once
+// with the Direct backend, then reports the relative RMS acceleration
+// error and wall time of FMMGravity for each expansion order (Barnes-Hut
+// at the same theta is listed for reference).
+//
+// The second table times the three backends on clouds of doubling size up
+// to [max fragments], with FMM at the lowest order that is as accurate as
+// Barnes-Hut, and reports where FMM overtakes the direct sum.
+//
+// usage: fmm_bench [fragments] [max order] [theta] [softening] [max fragments]
+// The FMM far field is unsoftened, so with softening > 0 the error levels
+// off once it reaches the softening mismatch; pass 0 to see pure
+// truncation error.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <random>
+
+#include "SelfGravity.h"
+
+double relativeRmsError(const FragmentSoA& f, const vector<double>& ex, const vector<double>& ey, const vector<double>& ez){
+    double err = 0.0, norm = 0.0;
+    for(size_t i = 0; i < f.size(); ++i){
+        double dx = f.ax[i] - ex[i], dy = f.ay[i] - ey[i], dz = f.az[i] - ez[i];
+        err += dx*dx + dy*dy + dz*dz;
+        norm += ex[i]*ex[i] + ey[i]*ey[i] + ez[i]*ez[i];
+    }
+    return sqrt(err/norm);
+}
+
+void clearAcceleration(FragmentSoA& f){
+    fill(f.ax.begin(), f.ax.end(), 0.0f);
+    fill(f.ay.begin(), f.ay.end(), 0.0f);
+    fill(f.az.begin(), f.az.end(), 0.0f);
+}
+
+// Unit sphere; half the points outside r = 0.5 are rejected, giving a
+// denser core like a freshly disrupted moon.
+FragmentSoA debrisCloud(long n){
+    FragmentSoA fragments;
+    mt19937 rng(7);
+    uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    uniform_real_distribution<float> fragMass(0.5f, 1.5f);
+    while((long)fragments.size() < n){
+        glm::vec3 p(unit(rng), unit(rng), unit(rng));
+        float r2 = glm::dot(p, p);
+        if(r2 > 1.0f) continue;
+        if(r2 > 0.25f && unit(rng) < 0.0f) continue;
+        fragments.emplace_back(p, glm::vec3(0.0f), fragMass(rng)/(float)n);
+    }
+    return fragments;
+}
+
+double timeBackend(SelfGravity& selfGravity, GravityBackend backend, FragmentSoA& fragments){
+    selfGravity.backend = backend;
+    clearAcceleration(fragments);
+    double start = omp_get_wtime();
+    selfGravity.accumulate(fragments);
+    return omp_get_wtime() - start;
+}
+
+int main(int argc, char** argv){
+    long n = argc > 1 ? stol(argv[1]) : 20000;
+    int maxOrder = argc > 2 ? stoi(argv[2]) : 10;
+    float theta = argc > 3 ? stof(argv[3]) : 0.5f;
+    const float softening = argc > 4 ? stof(argv[4]) : 0.01f;
+    const long maxFragments = argc > 5 ? stol(argv[5]) : 8*n;
+
+    FragmentSoA fragments = debrisCloud(n);
+    cout << n << " fragments, theta " << theta
+         << ", " << omp_get_max_threads() << " threads\n" << endl;
+
+    SelfGravity selfGravity;
+    selfGravity.backend = GravityBackend::Direct;
+    selfGravity.direct.softening = softening;
+    clearAcceleration(fragments);
+    double start = omp_get_wtime();
+    selfGravity.accumulate(fragments);
+    double directTime = omp_get_wtime() - start;
+
+    cout << left << setw(16) << "backend" << right << setw(14) << "rel rms err" << setw(12) << "time [s]" << endl;
+    vector<double> ex(fragments.ax.begin(), fragments.ax.end());
+    vector<double> ey(fragments.ay.begin(), fragments.ay.end());
+    vector<double> ez(fragments.az.begin(), fragments.az.end());
+
+    cout << left << setw(16) << "direct" << right << setw(14) << 0.0
+         << setw(12) << fixed << setprecision(3) << directTime << endl;
+
+    selfGravity.backend = GravityBackend::BarnesHut;
+    selfGravity.barnesHut.theta = theta;
+    selfGravity.barnesHut.softening = softening;
+    clearAcceleration(fragments);
+    start = omp_get_wtime();
+    selfGravity.accumulate(fragments);
+    double elapsed = omp_get_wtime() - start;
+    const double barnesHutError = relativeRmsError(fragments, ex, ey, ez);
+    cout << left << setw(16) << "barnes-hut" << right << setw(14) << scientific << setprecision(3)
+         << barnesHutError << setw(12) << fixed << elapsed << endl;
+
+    selfGravity.backend = GravityBackend::FMM;
+    selfGravity.fmm.theta = theta;
+    selfGravity.fmm.softening = softening;
+    int matchedOrder = 0;
+    for(int p = 1; p <= maxOrder; ++p){
+        selfGravity.fmm.order = p;
+        clearAcceleration(fragments);
+        start = omp_get_wtime();
+        selfGravity.accumulate(fragments);
+        elapsed = omp_get_wtime() - start;
+        const double error = relativeRmsError(fragments, ex, ey, ez);
+        if(!matchedOrder && error <= barnesHutError) matchedOrder = p;
+        cout << left << setw(16) << ("fmm p=" + to_string(p)) << right << setw(14) << scientific << setprecision(3)
+             << error << setw(12) << fixed << elapsed << endl;
+    }
+
+    // Scaling at the matched order. Each backend runs once untimed first so
+    // the FMM kernel table and the tree buffers are warm, as they are after
+    // the first step of a simulation.
+    selfGravity.fmm.order = matchedOrder ? matchedOrder : maxOrder;
+    cout << "\nscaling, fmm at p=" << selfGravity.fmm.order
+         << (matchedOrder ? " (as accurate as barnes-hut)\n" : " (highest order run)\n") << endl;
+    cout << right << setw(10) << "fragments" << setw(12) << "direct [s]" << setw(12) << "b-h [s]"
+         << setw(12) << "fmm [s]" << setw(14) << "fmm/direct" << endl;
+    long crossover = 0;
+    for(long size = n; size <= maxFragments; size *= 2){
+        FragmentSoA cloud = debrisCloud(size);
+        timeBackend(selfGravity, GravityBackend::FMM, cloud);
+        const double direct = timeBackend(selfGravity, GravityBackend::Direct, cloud);
+        const double tree = timeBackend(selfGravity, GravityBackend::BarnesHut, cloud);
+        const double fmm = timeBackend(selfGravity, GravityBackend::FMM, cloud);
+        if(!crossover && fmm < direct) crossover = size;
+        cout << setw(10) << size << fixed << setprecision(3) << setw(12) << direct << setw(12) << tree
+             << setw(12) << fmm << setw(14) << setprecision(2) << fmm/direct << endl;
+    }
+    if(crossover) cout << "\nfmm is faster than direct from " << crossover << " fragments" << endl;
+    else cout << "\nfmm did not overtake direct up to " << maxFragments << " fragments" << endl;
+    return 0;
+}
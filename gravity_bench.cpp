@@ -0,0 +1,106 @@
+// gravity_bench.cpp
+// Micro-benchmark for the planet-to-fragment acceleration.
+// Compares the original length/normalize/force/mass formulation with
+// accelerationFromCentralBody and the SoA SIMD kernels.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstring>
+
+#include "Gravity.h"
+
+using Clock = std::chrono::steady_clock;
+
+// The formulation updateGravity used before accelerationFromCentralBody.
+glm::vec3 legacyAcceleration(const Body& planet, const Body& fragment){
+    glm::vec3 dir = planet.position - fragment.position;
+    float distance = glm::length(dir);
+    glm::vec3 dirNorm = glm::normalize(dir);
+
+    float force = G*planet.mass*fragment.mass/(distance*distance);
+
+    return (force/fragment.mass)*dirNorm;
+}
+
+template<typename F>
+double timeIt(int repeats, F&& f){
+    f();
+    auto start = Clock::now();
+    for(int r = 0; r < repeats; ++r) f();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const std::string& name, size_t n, int repeats, double seconds, double baseline){
+    double rate = n*(double)repeats/seconds/1e6;
+    std::cout << std::left << std::setw(34) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1) << rate << " M/s"
+              << std::setw(9) << std::setprecision(2) << baseline/seconds << "x" << std::endl;
+}
+
+int main(int argc, char** argv){
+    size_t n = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    int repeats = argc > 2 ? std::stoi(argv[2]) : 20;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> fragMass(0.01f, 1.0f);
+
+    Body planet(glm::vec3(0.0f), glm::vec3(0.0f), 1000.0f);
+    std::vector<Body> bodies;
+    FragmentSoA soa;
+    bodies.reserve(n);
+    soa.reserve(n);
+    for(size_t i = 0; i < n; ++i){
+        Body b(glm::vec3(coord(rng), coord(rng), coord(rng)), glm::vec3(0.0f), fragMass(rng));
+        bodies.push_back(b);
+        soa.push_back(b);
+    }
+    std::vector<glm::vec3> acc(n);
+    const float GM = G*planet.mass;
+
+    std::cout << n << " fragments x " << repeats << " repeats, single thread\n" << std::endl;
+
+    double legacy = timeIt(repeats, [&]{
+        for(size_t i = 0; i < n; ++i) acc[i] = legacyAcceleration(planet, bodies[i]);
+    });
+    double checkLegacy = acc[n/2].x;
+    report("legacy length+normalize+mass", n, repeats, legacy, legacy);
+
+    double shared = timeIt(repeats, [&]{
+        for(size_t i = 0; i < n; ++i) acc[i] = accelerationFromCentralBody(planet.position - bodies[i].position, GM);
+    });
+    double checkShared = acc[n/2].x;
+    report("accelerationFromCentralBody", n, repeats, shared, legacy);
+
+    SimdLevel best = activeSimdLevel();
+    for(int level = (int)SimdLevel::Scalar; level <= (int)best; ++level){
+        setSimdLevel((SimdLevel)level);
+        double t = timeIt(repeats, [&]{ computeCentralAcceleration(soa, planet.position, GM, false); });
+        report(std::string("SoA kernel ") + simdLevelName((SimdLevel)level), n, repeats, t, legacy);
+    }
+    setSimdLevel(best);
+
+    // Every vector kernel must match its scalar twin bit for bit. An odd
+    // count also exercises the scalar tail of each kernel.
+    const size_t checkCount = n - (n > 1 && n % 2 == 0 ? 1 : 0);
+    const CentralPull pull{planet.position.x, planet.position.y, planet.position.z, GM};
+    std::vector<float> vx(checkCount), vy(checkCount), vz(checkCount), rx(checkCount), ry(checkCount), rz(checkCount);
+    bool identical = true;
+    for(int level = (int)SimdLevel::Scalar; level <= (int)best; ++level){
+        kernelFor((SimdLevel)level)(soa.px.data(), soa.py.data(), soa.pz.data(), vx.data(), vy.data(), vz.data(), checkCount, pull);
+        referenceKernelFor((SimdLevel)level)(soa.px.data(), soa.py.data(), soa.pz.data(), rx.data(), ry.data(), rz.data(), checkCount, pull);
+        size_t mismatches = 0;
+        for(size_t i = 0; i < checkCount; ++i)
+            mismatches += std::memcmp(&vx[i], &rx[i], sizeof(float)) != 0 || std::memcmp(&vy[i], &ry[i], sizeof(float)) != 0 ||
+                          std::memcmp(&vz[i], &rz[i], sizeof(float)) != 0;
+        std::cout << "bitwise " << simdLevelName((SimdLevel)level) << " vs scalar twin: "
+                  << (mismatches ? std::to_string(mismatches) + " mismatches" : std::string("identical")) << std::endl;
+        identical = identical && mismatches == 0;
+    }
+
+    std::cout << "\ncheck: " << checkLegacy << " " << checkShared << " " << soa.ax[n/2] << std::endl;
+    return identical ? 0 : 1;
+}
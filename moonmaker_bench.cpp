@@ -0,0 +1,90 @@
+// moonmaker_bench.cpp
+// Scaling benchmark for fragment generation at breakup: for every packing
+// the serial generator, then the parallel one from 1 thread up to all
+// cores.
+//
+//   moonmaker_bench [fragment_radius] [repeats]
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#include <omp.h>
+
+#include "MoonMaker.h"
+
+using Clock = std::chrono::steady_clock;
+
+template<typename F>
+double timeIt(int repeats, F&& f){
+    f();
+    auto start = Clock::now();
+    for(int r = 0; r < repeats; ++r) f();
+    return std::chrono::duration<double>(Clock::now() - start).count()/repeats;
+}
+
+void report(const std::string& name, size_t n, double seconds, double baseline, int threads){
+    std::cout << std::left << std::setw(22) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(2) << seconds*1e3 << " ms"
+              << std::setw(10) << std::setprecision(1) << n/seconds/1e6 << " M/s"
+              << std::setw(9) << std::setprecision(2) << baseline/seconds << "x"
+              << std::setw(9) << std::setprecision(0) << 100.0*baseline/seconds/threads << "%" << std::endl;
+}
+
+int main(int argc, char** argv){
+    double fragmentRadius = argc > 1 ? std::stod(argv[1]) : 0.01;
+    int repeats = argc > 2 ? std::stoi(argv[2]) : 5;
+    const glm::vec3 centre(3.0f, 0.0f, 0.0f), velocity(0.0f, 3.0f, 0.0f);
+    const double moonRadius = 0.5;
+    const int maxThreads = omp_get_num_procs();
+
+    // A fresh FragmentSoA per call, as at breakup, so allocation is timed too.
+    auto generate = [&](auto maker){
+        FragmentSoA fragments;
+        maker(centre, velocity, moonRadius, fragmentRadius, fragments);
+        return fragments.size();
+    };
+    struct Packing{
+        const char* name;
+        void (*serial)(glm::vec3, glm::vec3, double, double, FragmentSoA&);
+        void (*parallel)(glm::vec3, glm::vec3, double, double, FragmentSoA&);
+    };
+    const Packing packings[] = {
+        {"cubic",   serial_calculate_centres_and_mass_serial,  parallel_calculate_centres_and_mass_serial},
+        {"fcc",     serial_calculate_fcc_centres_and_mass,     parallel_calculate_fcc_centres_and_mass},
+        {"hcp",     serial_calculate_hcp_centres_and_mass,     parallel_calculate_hcp_centres_and_mass},
+        {"poisson", serial_calculate_poisson_centres_and_mass, parallel_calculate_poisson_centres_and_mass},
+    };
+    std::vector<int> threadCounts;
+    for(int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "fragment radius " << fragmentRadius << ", " << repeats << " repeats, up to " << maxThreads << " threads" << std::endl;
+    for(const Packing& packing : packings){
+        size_t n = generate(packing.serial);
+        double fill = n*std::pow(fragmentRadius/moonRadius, 3);
+        std::cout << "\n" << packing.name << ": " << n << " fragments, " << std::fixed << std::setprecision(1)
+                  << 100.0*fill << "% of the moon filled" << std::endl;
+        std::cout << std::left << std::setw(22) << "" << std::right << std::setw(13) << "time" << std::setw(14) << "rate"
+                  << std::setw(10) << "speedup" << std::setw(10) << "eff." << std::endl;
+
+        double serial = timeIt(repeats, [&]{ generate(packing.serial); });
+        report("serial", n, serial, serial, 1);
+
+        // Speedup and efficiency are against the serial generator.
+        for(int threads : threadCounts){
+            omp_set_num_threads(threads);
+            size_t produced = 0;
+            double t = timeIt(repeats, [&]{ produced = generate(packing.parallel); });
+            if(produced != n){
+                std::cerr << packing.name << ": parallel generator produced " << produced << " fragments, expected " << n << std::endl;
+                return 1;
+            }
+            report("parallel " + std::to_string(threads) + " thread" + (threads > 1 ? "s" : ""), n, t, serial, threads);
+        }
+    }
+    return 0;
+}
@@ -10,19 +10,27 @@
 #include <vector>
 #include <utility>
 #include <cmath>
+#include <algorithm>
 
 #include "MoonMaker.h"
+#include "ShaderProgram.h"
 #include "Sphere.h"
+#include "SphereLOD.h"
+#include "FrustumCull.h"
 #include "Gravity.h"
-#include "roche.h"
+#include "Simulation.h"
+#include "PhysicsThread.h"
+#include "Config.h"
 
 // -------------------- Shader Sources --------------------
 const char* vertexShaderSource = R"(
 #version 330 core
 layout (location = 0) in vec3 aPos;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
@@ -37,33 +45,98 @@ void main() {
 }
 )";
 
-// -------------------- Shader Compile --------------------
-GLuint compileShader(GLenum type, const char* src) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-    glCompileShader(shader);
-
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char infoLog[1024];
-        glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
-        std::cerr << "Shader compilation error (type " << type << "):\n" << infoLog << std::endl;
-    }
-    return shader;
+// Fragments: one instanced draw, offset/scale and colour per instance.
+const char* instancedVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aOffsetScale;
+layout (location = 2) in vec3 aColor;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+out vec3 vColor;
+void main() {
+    vColor = aColor;
+    gl_Position = projection * view * vec4(aPos * aOffsetScale.w + aOffsetScale.xyz, 1.0);
 }
+)";
 
-bool checkProgramLinkStatus(GLuint prog) {
-    GLint success;
-    glGetProgramiv(prog, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[1024];
-        glGetProgramInfoLog(prog, sizeof(infoLog), nullptr, infoLog);
-        std::cerr << "Program link error:\n" << infoLog << std::endl;
-        return false;
-    }
-    return true;
+const char* instancedFragmentShaderSource = R"(
+#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(vColor, 1.0);
+}
+)";
+
+// Fragments as point sprites: each pixel's view ray is intersected with
+// the sphere in the fragment shader, so silhouettes and depth stay right
+// under perspective, and the sphere's own depth is written. The sprite is
+// sized to cover the projected sphere wherever it sits on screen.
+const char* impostorVertexShaderSource = R"(
+#version 330 core
+layout (location = 1) in vec4 aOffsetScale;
+layout (location = 2) in vec3 aColor;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+uniform float radius;
+uniform float viewportHeight;
+out vec3 vColor;
+out vec3 vCenter;
+out float vRadius;
+out vec2 vNdcCenter;
+out float vHalfHeight;
+void main() {
+    vec4 center = view * vec4(aOffsetScale.xyz, 1.0);
+    vColor = aColor;
+    vCenter = center.xyz;
+    vRadius = radius * aOffsetScale.w;
+    gl_Position = projection * center;
+    // Off axis and up close a sphere projects larger than radius/depth.
+    float depth = gl_Position.w;
+    float offAxis = max(abs(center.x), abs(center.y)) / depth;
+    gl_PointSize = viewportHeight * projection[1][1] * vRadius * (1.0 + offAxis) / max(depth - vRadius, 1e-3);
+    vNdcCenter = gl_Position.xy / depth;
+    vHalfHeight = gl_PointSize / viewportHeight;
 }
+)";
+
+const char* impostorFragmentShaderSource = R"(
+#version 330 core
+in vec3 vColor;
+in vec3 vCenter;
+in float vRadius;
+in vec2 vNdcCenter;
+in float vHalfHeight;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+out vec4 FragColor;
+void main() {
+    vec2 c = gl_PointCoord * 2.0 - 1.0;
+    c.y = -c.y;
+    // View-space ray through this pixel, by inverting the perspective
+    // projection at depth 1; the sprite is square in pixels.
+    vec2 ndc = vNdcCenter + c * vec2(vHalfHeight * projection[0][0] / projection[1][1], vHalfHeight);
+    vec3 ray = vec3((ndc.x + projection[2][0]) / projection[0][0], (ndc.y + projection[2][1]) / projection[1][1], -1.0);
+    // Nearer root of |t*ray - center| = radius.
+    float a = dot(ray, ray);
+    float b = dot(ray, vCenter);
+    float disc = b * b - a * (dot(vCenter, vCenter) - vRadius * vRadius);
+    if (disc < 0.0) discard;
+    vec3 hit = ray * ((b - sqrt(disc)) / a);
+    vec3 normal = (hit - vCenter) / vRadius;
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+    float light = 0.35 + 0.65 * max(dot(normal, normalize(vec3(0.4, 0.6, 1.0))), 0.0);
+    FragColor = vec4(vColor * light, 1.0);
+}
+)";
 
 // -------------------- Camera --------------------
 glm::vec3 cameraPos   = glm::vec3(0.0f, 0.0f, 10.0f);
@@ -77,9 +150,17 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+int framebufferHeight = 600;
+bool impostorMode = false;  // P toggles point-sprite fragments
+
 // -------------------- Callbacks --------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    framebufferHeight = height;
+}
+
+void key_callback(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/) {
+    if(key == GLFW_KEY_P && action == GLFW_PRESS) impostorMode = !impostorMode;
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -120,7 +201,15 @@ void processInput(GLFWwindow* window){
 }
 
 // -------------------- Main --------------------
-int main(){
+int main(int argc, char** argv){
+    // Scenario from --config=FILE and --key=value overrides (see Config.h).
+    Scenario scenario;
+    if(!loadScenario(argc, argv, scenario)) return -1;
+    const float planetMass = scenario.planetMass, planetRadius = scenario.planetRadius;
+    const float moonMass = scenario.moonMass, moonRadius = scenario.moonRadius;
+    const float moonDistance = scenario.moonDistance;
+    const float moonVelocityY = scenario.moonVelocityY, moonVelocityZ = scenario.moonVelocityZ;
+
     if(!glfwInit()) return -1;
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,3);
@@ -135,50 +224,31 @@ int main(){
 
     glfwSetFramebufferSizeCallback(window,framebuffer_size_callback);
     glfwSetCursorPosCallback(window,mouse_callback);
+    glfwSetKeyCallback(window,key_callback);
     glfwSetInputMode(window,GLFW_CURSOR,GLFW_CURSOR_DISABLED);
 
     if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
         std::cerr << "Failed to init GLAD\n";
         return -1;
     }
-
-    // Compile shaders and link program
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram,vertexShader);
-    glAttachShader(shaderProgram,fragmentShader);
-    glLinkProgram(shaderProgram);
-    if(!checkProgramLinkStatus(shaderProgram)) return -1;
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+    // Compile shaders and link programs; uniform locations are resolved once here.
+    ShaderProgram shaderProgram(vertexShaderSource, fragmentShaderSource);
+    ShaderProgram instancedProgram(instancedVertexShaderSource, instancedFragmentShaderSource);
+    ShaderProgram impostorProgram(impostorVertexShaderSource, impostorFragmentShaderSource);
+    if(!shaderProgram.valid() || !instancedProgram.valid() || !impostorProgram.valid()) return -1;
+
+    CameraUniforms camera;
+    camera.attach(shaderProgram);
+    camera.attach(instancedProgram);
+    camera.attach(impostorProgram);
+    const GLint modelLocation = shaderProgram.uniform("model");
+    const GLint colorLocation = shaderProgram.uniform("color");
+    const GLint impostorRadiusLocation = impostorProgram.uniform("radius");
+    const GLint impostorViewportLocation = impostorProgram.uniform("viewportHeight");
 
     // ---------------- Initial bodies ----------------
-    // Get user input for simulation parameters
-    float planetMass, planetRadius, moonMass, moonRadius;
-    float moonDistance, moonVelocityY, moonVelocityZ;
-
-    std::cout << "Enter planet mass: ";
-    std::cin >> planetMass;
-
-    std::cout << "Enter planet radius: ";
-    std::cin >> planetRadius;
-
-    std::cout << "Enter moon mass: ";
-    std::cin >> moonMass;
-
-    std::cout << "Enter moon radius: ";
-    std::cin >> moonRadius;
-
-    std::cout << "Enter moon distance from planet: ";
-    std::cin >> moonDistance;
-
-    std::cout << "Enter moon velocity (Y component): ";
-    std::cin >> moonVelocityY;
-
-    std::cout << "Enter moon velocity (Z component): ";
-    std::cin >> moonVelocityZ;
-
     // Calculate and display Roche limit
     double densPlanet = planetMass / ((4.0 / 3.0) * M_PI * pow(planetRadius, 3));
     double densMoon = moonMass / ((4.0 / 3.0) * M_PI * pow(moonRadius, 3));
@@ -191,19 +261,32 @@ int main(){
     std::cout << "Moon Distance: " << moonDistance << std::endl;
     std::cout << "Recommended orbital velocity for stable orbit: " << orbitalVelocity << std::endl;
     std::cout << "Your velocity magnitude: " << sqrt(moonVelocityY*moonVelocityY + moonVelocityZ*moonVelocityZ) << "\n" << std::endl;
-
-    bool passed_roche_limit = false;
-    bool fragment_initialized = false;
+    std::cout << "Integrator: " << integratorName(scenario.integrator)
+              << "  Timesteps: " << (scenario.blockTimesteps ? "block" : "global")
+              << "  Gravity: " << gravityBackendName(scenario.gravity)
+              << "  Packing: " << fragmentPackingName(scenario.packing) << std::endl;
+    std::cout << "Press P to toggle point-sprite fragments." << std::endl;
 
     Sphere planetSphere(planetRadius, 36, 18);
     Sphere moonSphere(moonRadius, 36, 18);
-    Sphere fragmentSphere(0.05f, 12, 12);
+    Sphere fragmentSphere(scenario.fragmentRadius, 12, 12);
+    SphereLOD fragmentLOD(scenario.fragmentRadius);
+    std::vector<unsigned char> fragmentLevels, fragmentVisible;
+    std::vector<glm::vec3> fragmentPositions;
+    std::vector<size_t> levelCounts(fragmentLOD.levelCount()), levelCursor(fragmentLOD.levelCount());
 
     Body planet(glm::vec3(0.0f,0.0f,0.0f), glm::vec3(0.0f), planetMass);
     Body moon(glm::vec3(moonDistance,0.0f,0.0f), glm::vec3(0.0f, moonVelocityY, moonVelocityZ), moonMass);
-    std::vector<Body> fragments;
+    Simulation simulation(planet, moon, planetRadius, moonRadius, serial_calculate_centres_and_mass_serial, false);
+    applyScenario(scenario, simulation);
+
+    // Physics runs on its own thread from here on; the render loop only
+    // reads the snapshots it publishes.
+    PhysicsThread physics(simulation);
+    physics.start();
 
     glEnable(GL_DEPTH_TEST);
+    glEnable(GL_PROGRAM_POINT_SIZE);
 
     // FPS counter variables
     double lastFPSTime = glfwGetTime();
@@ -236,63 +319,76 @@ int main(){
             lastFPSTime = currentFrame;
         }
 
-        // Cap deltaTime to prevent numerical instability
-        if(deltaTime > 0.016f) deltaTime = 0.016f; // Max ~60 FPS
-
         processInput(window);
 
         glClearColor(0.05f,0.05f,0.1f,1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(shaderProgram);
+        shaderProgram.use();
 
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos+cameraFront, cameraUp);
         glm::mat4 projection = glm::perspective(glm::radians(45.0f),800.0f/600.0f,0.1f,100.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"view"),1,GL_FALSE,glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"projection"),1,GL_FALSE,glm::value_ptr(projection));
-
-        // ---------------- Update positions ----------------
-        if(!passed_roche_limit)
-            passed_roche_limit = update_roche_status(planet, moon, planetRadius, moonRadius);
-
-        if(passed_roche_limit && !fragment_initialized){
-            auto centers_and_masses = serial_calculate_centres_and_mass_serial(
-                {moon.position.x, moon.position.y, moon.position.z}, moonRadius, 0.05
-            );
-            for(auto &f : centers_and_masses){
-                fragments.emplace_back(
-                    glm::vec3((float)f.first[0], (float)f.first[1], (float)f.first[2]),
-                    glm::vec3((float)moon.velocity[0],(float)moon.velocity[1], (float)moon.velocity[2] ),
-                    f.second
-                );
-            }
-            fragment_initialized = true;
-        }
+        camera.update(view, projection);
 
-        // Gravity update
-        if(fragment_initialized)
-            serialUpdateGravity(planet, fragments, deltaTime);
-        else
-            updateGravity(planet, moon, deltaTime);
+        // ---------------- Latest physics state ----------------
+        const SimulationSnapshot& snapshot = physics.latest();
+        const float alpha = snapshot.alpha();
 
         // ---------------- Draw planet ----------------
         glm::mat4 model = glm::mat4(1.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"model"),1,GL_FALSE,glm::value_ptr(model));
-        glUniform3f(glGetUniformLocation(shaderProgram,"color"),0.2f,0.7f,1.0f);
+        glUniformMatrix4fv(modelLocation,1,GL_FALSE,glm::value_ptr(model));
+        glUniform3f(colorLocation,0.2f,0.7f,1.0f);
         planetSphere.draw();
 
         // ---------------- Draw moon / fragments ----------------
-        if(fragment_initialized){
-            for(auto &f : fragments){
-                glm::mat4 m = glm::translate(glm::mat4(1.0f), f.position);
-                glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"model"),1,GL_FALSE,glm::value_ptr(m));
-                glUniform3f(glGetUniformLocation(shaderProgram,"color"),1.0f,0.5f,0.0f);
-                fragmentSphere.draw();
+        if(snapshot.fragmentsInitialized){
+            // Frustum culling first; only visible fragments are uploaded and drawn.
+            const size_t count = snapshot.fragmentCount();
+            fragmentVisible.resize(count);
+            fragmentPositions.resize(count);
+            const Frustum frustum = Frustum::fromMatrix(projection*view);
+            const size_t visibleCount = cullSpheres(frustum, snapshot.previousFragmentX.data(), snapshot.previousFragmentY.data(),
+                                                    snapshot.previousFragmentZ.data(), snapshot.fragmentX.data(),
+                                                    snapshot.fragmentY.data(), snapshot.fragmentZ.data(), alpha, count,
+                                                    fragmentLOD.radius(), fragmentPositions.data(), fragmentVisible.data());
+            if(impostorMode){
+                SphereInstance* instances = fragmentSphere.mapInstances(visibleCount);
+                size_t slot = 0;
+                for(size_t i = 0; i < count; ++i){
+                    if(!fragmentVisible[i]) continue;
+                    const glm::vec3& p = fragmentPositions[i];
+                    instances[slot++] = {p.x, p.y, p.z, 1.0f, 1.0f, 0.5f, 0.0f};
+                }
+                impostorProgram.use();
+                glUniform1f(impostorRadiusLocation,fragmentSphere.radius());
+                glUniform1f(impostorViewportLocation,(float)framebufferHeight);
+                fragmentSphere.drawImpostors();
+            } else {
+                // Bucket fragments by on-screen radius, one instanced draw per LOD level.
+                const float pixelScale = 0.5f*framebufferHeight*projection[1][1]*fragmentLOD.radius();
+                fragmentLevels.resize(count);
+                std::fill(levelCounts.begin(), levelCounts.end(), 0);
+                for(size_t i = 0; i < count; ++i){
+                    if(!fragmentVisible[i]) continue;
+                    float distance = glm::length(fragmentPositions[i] - cameraPos);
+                    int level = fragmentLOD.levelFor(pixelScale/std::max(distance, 1e-4f));
+                    fragmentLevels[i] = (unsigned char)level;
+                    ++levelCounts[level];
+                }
+                SphereInstance* instances = fragmentLOD.mapInstances(levelCounts.data());
+                for(int k = 0; k < fragmentLOD.levelCount(); ++k) levelCursor[k] = fragmentLOD.bucketOffset(k);
+                for(size_t i = 0; i < count; ++i){
+                    if(!fragmentVisible[i]) continue;
+                    const glm::vec3& p = fragmentPositions[i];
+                    instances[levelCursor[fragmentLevels[i]]++] = {p.x, p.y, p.z, 1.0f, 1.0f, 0.5f, 0.0f};
+                }
+                instancedProgram.use();
+                fragmentLOD.drawInstanced();
             }
         } else {
-            glm::mat4 m = glm::translate(glm::mat4(1.0f), moon.position);
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram,"model"),1,GL_FALSE,glm::value_ptr(m));
-            glUniform3f(glGetUniformLocation(shaderProgram,"color"),1.0f,0.5f,0.0f);
+            glm::mat4 m = glm::translate(glm::mat4(1.0f), snapshot.moon(alpha));
+            glUniformMatrix4fv(modelLocation,1,GL_FALSE,glm::value_ptr(m));
+            glUniform3f(colorLocation,1.0f,0.5f,0.0f);
             moonSphere.draw();
         }
 
@@ -300,6 +396,7 @@ int main(){
         glfwPollEvents();
     }
 
+    physics.stop();
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,247 @@
+// sweep_main.cpp
+// Runs a grid of headless scenarios concurrently and prints one summary
+// row per run: where the moon broke up relative to get_roche_radius.
+//
+//   roche_sweep [--config=FILE] [--scenario=NAME] [--key=value ...]
+//               --vary=KEY=START:STOP:COUNT | --vary=KEY=V1,V2,...  (repeatable)
+//               [--threads-per-sim=N] [--after-breakup=STEPS] [--summary=FILE]
+//
+// The base scenario is read as in the other mains (Config.h); every --vary
+// adds one axis to the grid and the runs are its Cartesian product. Besides
+// the Config.h keys, moon.density_ratio (moon density / planet density)
+// can be varied; it sets the moon mass for the current moon radius.
+//
+// Each run steps until breakup plus --after-breakup steps, or until
+// simulation.steps if the moon never breaks up. With at least as many runs
+// as threads every run gets one thread; with fewer runs the threads are
+// split between them and each run uses the parallel physics path.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Config.h"
+#include "MoonMaker.h"
+#include "Simulation.h"
+#include "roche.h"
+
+struct SweepAxis {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+struct SweepResult {
+    double rocheRadius = 0.0;
+    double periapsis = 0.0;         // closest approach before breakup (or over the run)
+    double breakupTime = -1.0;
+    double breakupDistance = 0.0;
+    double spread = 0.0;            // RMS fragment distance from their mean position at the end
+    size_t fragments = 0;
+    long steps = 0;
+    double seconds = 0.0;
+};
+
+// "3:8:6" -> six evenly spaced values, "a,b,c" -> the listed values.
+static bool parseAxis(const std::string& spec, SweepAxis& axis){
+    size_t eq = spec.find('=');
+    if(eq == std::string::npos || eq == 0) return false;
+    axis.key = expandShorthand(spec.substr(0, eq));
+    std::string range = spec.substr(eq + 1);
+    size_t c1 = range.find(':');
+    if(c1 != std::string::npos){
+        size_t c2 = range.find(':', c1 + 1);
+        if(c2 == std::string::npos) return false;
+        double start = std::atof(range.substr(0, c1).c_str());
+        double stop = std::atof(range.substr(c1 + 1, c2 - c1 - 1).c_str());
+        int count = std::atoi(range.substr(c2 + 1).c_str());
+        if(count < 1) return false;
+        for(int i = 0; i < count; ++i){
+            double v = count == 1 ? start : start + (stop - start)*i/(count - 1);
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.9g", v);
+            axis.values.push_back(buffer);
+        }
+    } else {
+        size_t begin = 0;
+        while(begin <= range.size()){
+            size_t comma = range.find(',', begin);
+            if(comma == std::string::npos) comma = range.size();
+            std::string value = Config::trim(range.substr(begin, comma - begin));
+            if(!value.empty()) axis.values.push_back(value);
+            begin = comma + 1;
+        }
+    }
+    return !axis.values.empty();
+}
+
+static SweepResult runScenario(const Scenario& scenario, long afterBreakup, bool parallel){
+    SweepResult result;
+    Body planet(glm::vec3(0.0f), glm::vec3(0.0f), scenario.planetMass);
+    Body moon(glm::vec3(scenario.moonDistance, 0.0f, 0.0f),
+              glm::vec3(0.0f, scenario.moonVelocityY, scenario.moonVelocityZ), scenario.moonMass);
+    Simulation simulation(planet, moon, scenario.planetRadius, scenario.moonRadius,
+                          parallel ? parallel_calculate_centres_and_mass_serial : serial_calculate_centres_and_mass_serial,
+                          parallel);
+    applyScenario(scenario, simulation);
+    result.rocheRadius = get_roche_radius(planet, moon, scenario.planetRadius, scenario.moonRadius);
+    result.periapsis = scenario.moonDistance;
+
+    const float dTime = (float)simulation.clock.step;
+    auto start = std::chrono::steady_clock::now();
+    long stepsAfter = 0;
+    for(long s = 0; s < scenario.steps || simulation.fragmentsInitialized; ++s){
+        if(simulation.fragmentsInitialized && stepsAfter++ >= afterBreakup) break;
+        if(!simulation.fragmentsInitialized)
+            result.periapsis = std::min(result.periapsis, (double)glm::length(simulation.moon.position - simulation.planet.position));
+        simulation.step(dTime);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.steps = simulation.stepCount;
+    result.breakupTime = simulation.breakupTime;
+
+    if(simulation.fragmentsInitialized){
+        const FragmentSoA& f = simulation.fragments;
+        result.fragments = f.size();
+        // The moon body is no longer advanced once it has broken up.
+        result.breakupDistance = glm::length(simulation.moon.position - simulation.planet.position);
+        // Unweighted: the density profile puts most of the mass in the centre fragment.
+        double cx = 0.0, cy = 0.0, cz = 0.0;
+        for(size_t i = 0; i < f.size(); ++i){ cx += f.px[i]; cy += f.py[i]; cz += f.pz[i]; }
+        cx /= f.size(); cy /= f.size(); cz /= f.size();
+        double sum = 0.0;
+        for(size_t i = 0; i < f.size(); ++i)
+            sum += (f.px[i] - cx)*(f.px[i] - cx) + (f.py[i] - cy)*(f.py[i] - cy) + (f.pz[i] - cz)*(f.pz[i] - cz);
+        result.spread = std::sqrt(sum/f.size());
+    }
+    return result;
+}
+
+int main(int argc, char** argv){
+    std::vector<SweepAxis> axes;
+    int threadsPerSim = 0;
+    long afterBreakup = 0;
+    std::string summaryPath = "sweep_summary.csv";
+
+    // Sweep options are taken out here; everything else goes to loadScenario.
+    std::vector<char*> rest{argv[0]};
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        auto option = [&](const char* name, std::string& value){
+            std::string prefix = std::string("--") + name;
+            if(arg == prefix && i + 1 < argc){ value = argv[++i]; return true; }
+            if(arg.compare(0, prefix.size() + 1, prefix + "=") == 0){ value = arg.substr(prefix.size() + 1); return true; }
+            return false;
+        };
+        std::string value;
+        if(option("vary", value)){
+            SweepAxis axis;
+            if(!parseAxis(value, axis)){
+                std::cerr << "bad --vary " << value << " (expected KEY=START:STOP:COUNT or KEY=V1,V2,...)\n";
+                return 1;
+            }
+            axes.push_back(axis);
+        }
+        else if(option("threads-per-sim", value)) threadsPerSim = std::atoi(value.c_str());
+        else if(option("after-breakup", value)) afterBreakup = std::atol(value.c_str());
+        else if(option("summary", value)) summaryPath = value;
+        else rest.push_back(argv[i]);
+    }
+
+    Scenario base;
+    if(!loadScenario((int)rest.size(), rest.data(), base)) return 1;
+
+    // Cartesian product of the axes, first axis varying slowest.
+    size_t runCount = 1;
+    for(const SweepAxis& axis : axes) runCount *= axis.values.size();
+    std::vector<Scenario> scenarios(runCount, base);
+    std::vector<std::vector<std::string>> labels(runCount);
+    for(size_t run = 0; run < runCount; ++run){
+        Config config;
+        std::string densityRatio;
+        size_t index = run;
+        for(size_t a = axes.size(); a-- > 0;){
+            const std::string& value = axes[a].values[index % axes[a].values.size()];
+            index /= axes[a].values.size();
+            labels[run].insert(labels[run].begin(), value);
+            if(axes[a].key == "moon.density_ratio") densityRatio = value;
+            else config.set(axes[a].key, value);
+        }
+        std::string error;
+        if(!applyConfig(config, "", scenarios[run], error)){
+            std::cerr << error << "\n";
+            return 1;
+        }
+        if(!densityRatio.empty()){
+            Scenario& s = scenarios[run];
+            double planetDensity = s.planetMass/((4.0/3.0)*M_PI*std::pow(s.planetRadius, 3));
+            s.moonMass = (float)(std::atof(densityRatio.c_str())*planetDensity*(4.0/3.0)*M_PI*std::pow(s.moonRadius, 3));
+        }
+    }
+
+    // One run per thread when there are enough runs to go round, otherwise
+    // split the threads between the runs.
+    const int threads = omp_get_max_threads();
+    if(threadsPerSim <= 0) threadsPerSim = std::max(1, threads/(int)std::max<size_t>(runCount, 1));
+    threadsPerSim = std::min(threadsPerSim, threads);
+    const int concurrent = std::max(1, std::min(threads/threadsPerSim, (int)runCount));
+    if(threadsPerSim > 1) omp_set_max_active_levels(2);
+    std::cout << runCount << " runs, " << concurrent << " at a time, " << threadsPerSim << " thread(s) each\n";
+
+    std::vector<SweepResult> results(runCount);
+    size_t finished = 0;
+    auto start = std::chrono::steady_clock::now();
+    #pragma omp parallel for num_threads(concurrent) schedule(dynamic, 1)
+    for(long run = 0; run < (long)runCount; ++run){
+        omp_set_num_threads(threadsPerSim);
+        results[run] = runScenario(scenarios[run], afterBreakup, threadsPerSim > 1);
+        #pragma omp critical
+        {
+            ++finished;
+            std::cerr << "\r" << finished << "/" << runCount << " done" << std::flush;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "\n";
+
+    // Summary: the varied values, then the outcome of each run.
+    std::string header = "run";
+    for(const SweepAxis& axis : axes) header += "," + axis.key;
+    header += ",roche_radius,periapsis,breakup_time,breakup_distance,breakup_over_roche,fragments,spread,steps,seconds";
+    std::ofstream out(summaryPath);
+    if(!out){
+        std::cerr << "Cannot write " << summaryPath << "\n";
+        return 1;
+    }
+    out << header << "\n";
+    std::printf("%5s", "run");
+    for(const SweepAxis& axis : axes) std::printf(" %14s", axis.key.c_str());
+    std::printf(" %10s %10s %10s %10s %8s %9s\n", "roche_r", "periapsis", "breakup_t", "d/roche", "frags", "seconds");
+    for(size_t run = 0; run < runCount; ++run){
+        const SweepResult& r = results[run];
+        const bool broke = r.breakupTime >= 0.0;
+        out << run;
+        std::printf("%5zu", run);
+        for(const std::string& label : labels[run]){
+            out << "," << label;
+            std::printf(" %14s", label.c_str());
+        }
+        out << "," << r.rocheRadius << "," << r.periapsis << "," << r.breakupTime << ","
+            << (broke ? r.breakupDistance : 0.0) << "," << (broke ? r.breakupDistance/r.rocheRadius : 0.0) << ","
+            << r.fragments << "," << r.spread << "," << r.steps << "," << r.seconds << "\n";
+        if(broke)
+            std::printf(" %10.4g %10.4g %10.4g %10.4g %8zu %9.3g\n", r.rocheRadius, r.periapsis, r.breakupTime,
+                        r.breakupDistance/r.rocheRadius, r.fragments, r.seconds);
+        else
+            std::printf(" %10.4g %10.4g %10s %10s %8s %9.3g\n", r.rocheRadius, r.periapsis, "intact", "-", "-", r.seconds);
+    }
+    std::cout << "total wall time: " << seconds << " s, wrote " << summaryPath << "\n";
+    return 0;
+}